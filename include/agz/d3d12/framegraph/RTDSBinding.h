@@ -26,6 +26,12 @@ struct ClearStencil
     UINT8 stencil = 0;
 };
 
+// bind depth stencil buffer as read-only (DEPTH_READ),
+// so that it can be sampled in the same pass
+struct _internalReadOnlyDepthStencil { };
+
+constexpr _internalReadOnlyDepthStencil READ_ONLY_DEPTH_STENCIL = {};
+
 struct RenderTargetBinding
 {
     template<typename...Args>
@@ -47,6 +53,8 @@ struct DepthStencilBinding
     bool clearDepth;
     bool clearStencil;
     ClearDepthStencil clearDepthStencilValue;
+
+    bool readOnly;
 };
 
 AGZ_D3D12_FG_END
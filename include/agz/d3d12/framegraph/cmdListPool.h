@@ -18,9 +18,11 @@ public:
     void startFrame(
         int frameIndex);
 
-    ComPtr<ID3D12GraphicsCommandList> requireGraphicsCommandList(int threadIndex);
+    ComPtr<ID3D12GraphicsCommandList> requireCommandList(
+        int threadIndex, FrameGraphQueue queue);
 
-    void addUnusedGraphicsCmdLists(ComPtr<ID3D12GraphicsCommandList> cmdList);
+    void addUnusedCommandList(
+        FrameGraphQueue queue, ComPtr<ID3D12GraphicsCommandList> cmdList);
 
 private:
 
@@ -30,8 +32,9 @@ private:
 
     struct ThreadResource
     {
-        // frame index -> cmd alloc
-        std::vector<ComPtr<ID3D12CommandAllocator>> graphicsCmdAllocs_;
+        // queue -> frame index -> cmd alloc
+        std::vector<ComPtr<ID3D12CommandAllocator>>
+            cmdAllocs_[FRAME_GRAPH_QUEUE_COUNT];
     };
 
     std::vector<ThreadResource> threadResources_;
@@ -44,8 +47,10 @@ private:
     // 4. reported to execution thread
     // 5. (optional) pending
     // 6. added to unusedCmdLists_
-    std::vector<ComPtr<ID3D12GraphicsCommandList>> unusedGraphicsCmdLists_;
-    std::mutex unusedGraphicsCmdListsMutex_;
+    // cmd lists of different queues have different types
+    std::vector<ComPtr<ID3D12GraphicsCommandList>>
+        unusedCmdLists_[FRAME_GRAPH_QUEUE_COUNT];
+    std::mutex unusedCmdListsMutex_;
 };
 
 AGZ_D3D12_FG_END
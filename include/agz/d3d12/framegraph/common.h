@@ -18,6 +18,20 @@ struct ResourceIndex
 
 constexpr ResourceIndex RESOURCE_NIL = { -1 };
 
+// ring of rscs rotated every frame.
+// [0] is written in the current frame, [k] is the one written k frames ago
+struct HistoryResourceIndex
+{
+    ResourceIndex first;
+    int32_t historyLength = 0;
+
+    ResourceIndex operator[](int32_t k) const noexcept
+    {
+        assert(0 <= k && k < historyLength);
+        return { first.idx + k };
+    }
+};
+
 struct PassIndex
 {
     int32_t idx = -1;
@@ -29,6 +43,16 @@ struct PassIndex
 
 constexpr PassIndex PASS_NIL = { -1 };
 
+// cmd queue a pass is submitted to
+enum class FrameGraphQueue
+{
+    Graphics = 0,
+    Compute  = 1,
+    Copy     = 2
+};
+
+constexpr int FRAME_GRAPH_QUEUE_COUNT = 3;
+
 struct Register
 {
     constexpr Register(UINT num) noexcept : Register(0, num) { }
@@ -91,6 +115,51 @@ void InvokeAll(F0 &&f0, F1 &&f1, Fs &&...fs)
     InvokeAll(std::forward<F1>(f1), std::forward<Fs>(fs)...);
 }
 
+inline bool isWriteState(D3D12_RESOURCE_STATES state) noexcept
+{
+    const D3D12_RESOURCE_STATES WRITE_STATES =
+        D3D12_RESOURCE_STATE_RENDER_TARGET    |
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS |
+        D3D12_RESOURCE_STATE_DEPTH_WRITE      |
+        D3D12_RESOURCE_STATE_STREAM_OUT       |
+        D3D12_RESOURCE_STATE_COPY_DEST        |
+        D3D12_RESOURCE_STATE_RESOLVE_DEST;
+
+    return (state & WRITE_STATES) != 0;
+}
+
+inline bool hasStencil(DXGI_FORMAT format) noexcept
+{
+    return format == DXGI_FORMAT_D24_UNORM_S8_UINT ||
+           format == DXGI_FORMAT_D32_FLOAT_S8X24_UINT;
+}
+
+// whether cmd lists of the queue can transition rscs from/into the state
+inline bool isStateSupportedByQueue(
+    FrameGraphQueue queue, D3D12_RESOURCE_STATES state) noexcept
+{
+    if(queue == FrameGraphQueue::Graphics)
+        return true;
+
+    if(queue == FrameGraphQueue::Copy)
+    {
+        const D3D12_RESOURCE_STATES COPY_STATES =
+            D3D12_RESOURCE_STATE_COPY_DEST |
+            D3D12_RESOURCE_STATE_COPY_SOURCE;
+        return (state & ~COPY_STATES) == 0;
+    }
+
+    const D3D12_RESOURCE_STATES COMPUTE_STATES =
+        D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER |
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS           |
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE  |
+        D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT          |
+        D3D12_RESOURCE_STATE_COPY_DEST                  |
+        D3D12_RESOURCE_STATE_COPY_SOURCE;
+
+    return (state & ~COMPUTE_STATES) == 0;
+}
+
 // IMPROVE: use LUT
 inline bool isTypeless(DXGI_FORMAT format) noexcept
 {
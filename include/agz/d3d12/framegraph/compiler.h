@@ -1,8 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <string>
+
 #include <d3d12.h>
 
+#include <agz/d3d12/framegraph/copyBinding.h>
 #include <agz/d3d12/framegraph/graphData.h>
+#include <agz/d3d12/framegraph/passOption.h>
 #include <agz/d3d12/framegraph/resourceDesc.h>
 #include <agz/d3d12/framegraph/resourceAllocator.h>
 #include <agz/d3d12/framegraph/resourceReleaser.h>
@@ -11,6 +16,33 @@
 
 AGZ_D3D12_FG_BEGIN
 
+struct FrameGraphCompileOptions
+{
+    // reorder passes according to their rsc dependencies, so that state
+    // transitions and producer-consumer distances are reduced.
+    // output of the graph is identical to the one in declaration order.
+    bool reorderPasses = false;
+
+    // submit passes marked with ASYNC_COMPUTE to the async compute queue.
+    // FrameGraph disables it when no async compute queue is set
+    bool asyncCompute = true;
+
+    // submit copy passes to the copy queue.
+    // FrameGraph disables it when no copy queue is set
+    bool copyQueue = true;
+
+    // record graphics passes between BeginRenderPass/EndRenderPass, with
+    // load/store of rts/ds inferred from the graph. pass funcs must not
+    // record rsc barriers. falls back to OMSetRenderTargets when the cmd
+    // list does not support render passes
+    bool renderPasses = true;
+
+    // record adjacent graphics passes binding the same rts/ds with no
+    // barrier or clear between them in a single render pass or rt/ds
+    // binding. pass funcs are still called in order
+    bool mergePasses = true;
+};
+
 class FrameGraphCompiler : public misc::uncopyable_t
 {
 public:
@@ -37,6 +69,10 @@ public:
 
         D3D12_RESOURCE_STATES initialState = {};
         D3D12_RESOURCE_STATES finalState   = {};
+
+        // rscs of history rings are compiled as external rscs owned by
+        // the graph. -1 if the rsc is not in any ring
+        int32_t historyRing = -1;
     };
 
     using CompilerResourceNode = misc::variant_t<
@@ -60,13 +96,52 @@ public:
 
             int idxInRscUsers = -1;
 
+            struct TrackUsage
+            {
+                int32_t track = -1;
+                int idxInTrackUsers = -1;
+            };
+
+            // state tracks of subresources covered by the view
+            std::vector<TrackUsage> tracks;
+
+            // cover mip 0 of each array slice instead of all subresources.
+            // used by resolve destinations, which have no view
+            bool firstMipOnly = false;
+
             using RTDSBinding = FrameGraphPassNode::PassResource::RTDSBinding;
 
             RTDSBinding rtdsBinding;
         };
 
+        // index in declaration order
+        PassIndex index;
+
         bool isGraphics;
 
+        bool hasSideEffect = false;
+
+        // marked with ASYNC_COMPUTE
+        bool isAsyncCompute = false;
+
+        // added by addCopyPass
+        bool isCopy = false;
+
+        // added by addResolvePass
+        bool isResolve = false;
+
+        // marked with STATIC_PASS
+        bool isStatic = false;
+
+        // given by ParallelChunks
+        uint32_t chunkCount = 1;
+
+        // given by PassName
+        std::string name;
+
+        // assigned by the compiler
+        FrameGraphQueue queue = FrameGraphQueue::Graphics;
+
         FrameGraphPassFunc passFunc;
 
         std::vector<RscInPass> rscs;
@@ -102,29 +177,118 @@ public:
         D3D12_RESOURCE_STATES        initialState,
         D3D12_RESOURCE_STATES        finalState);
 
+    HistoryResourceIndex addHistoryResource(
+        const RscDesc &rscDesc, int32_t historyLength);
+
     template<typename...Args>
     PassIndex addGraphicsPass(FrameGraphPassFunc passFunc, Args &&...args);
 
     template<typename...Args>
     PassIndex addComputePass(FrameGraphPassFunc passFunc, Args &&...args);
 
+    template<typename...Args>
+    PassIndex addCopyPass(FrameGraphPassFunc passFunc, Args &&...args);
+
+    // resolve mip 0 of each array slice of multisampled src into dst.
+    // format is inferred from dst, or from src if dst is typeless
+    PassIndex addResolvePass(
+        ResourceIndex src,
+        ResourceIndex dst,
+        PassName      name   = {},
+        DXGI_FORMAT   format = DXGI_FORMAT_UNKNOWN);
+
+    // size of rscs declared with BackbufferRelativeSize
+    void setBackbufferSize(UINT width, UINT height);
+
+    // allocations depending on the backbuffer size are added to
+    // relativeRscReleaser, others are added to rscReleaser
     FrameGraphData compile(
+        ResourceAllocator              &rscAlloc,
+        ResourceReleaser               &rscReleaser,
+        ResourceReleaser               &relativeRscReleaser,
+        const FrameGraphCompileOptions &options = {});
+
+    // recreate backbuffer-relative rscs of a compiled graph with the new
+    // backbuffer size, and update default viewports inferred from them.
+    // allocations of the old rscs must be released by the caller.
+    // other rscs and the graph structure are untouched
+    static void resizeCompiledGraph(
+        FrameGraphData    &graph,
+        UINT               backbufferWidth,
+        UINT               backbufferHeight,
         ResourceAllocator &rscAlloc,
-        ResourceReleaser  &rscReleaser);
+        ResourceReleaser  &relativeRscReleaser);
+
+    // re-infer default viewports from the current size of the rsc
+    static void updateInferredViewports(
+        FrameGraphData &graph, ResourceIndex rsc);
+
+    // bind rscs of history rings for the next frame
+    static void rotateHistoryRings(FrameGraphData &graph);
+
+    // drop refs to external rscs, e.g. before the swap chain is resized
+    void clearExternalResources();
+
+    // serialized graph structure. graphs with the same key
+    // compile into identical FrameGraphData except for pass funcs,
+    // pipeline states, root signatures and external rscs
+    std::string getStructureKey(
+        const FrameGraphCompileOptions &options = {}) const;
+
+    // rebind pass funcs, pipeline states, root signatures and external rscs
+    // of a graph compiled from another compiler with the same structure key
+    void rebindCompiledGraph(FrameGraphData &graph) const;
 
 private:
 
+    struct CompilerHistoryRing
+    {
+        RscDesc desc;
+
+        ResourceIndex first;
+        int32_t historyLength = 0;
+    };
+
+    // subresources of a rsc covered by the same set of usages.
+    // states are tracked per track, so that passes using disjoint
+    // subresources of a rsc (e.g. generating a mipmap chain) never
+    // transition or wait for each other
+    struct StateTrack
+    {
+        ResourceIndex rsc;
+
+        // sorted subresource indices. empty means all subresources
+        std::vector<UINT> subresources;
+    };
+
     struct TempRscNode
     {
         std::vector<std::pair<PassIndex, D3D12_RESOURCE_STATES>> users;
+
+        // overlap policy of each user of a state track
+        std::vector<UAVOverlap> uavOverlaps;
+    };
+
+    struct DescriptorIndices
+    {
+        DescriptorIndex gpu = 0;
+        DescriptorIndex rtv = 0;
+        DescriptorIndex dsv = 0;
     };
 
     struct RscUsageInfo
     {
+        // usages of each rsc with their declared states
         std::vector<TempRscNode> rscTempNodes;
-        DescriptorCount gpuDescCount = 0;
-        DescriptorCount rtvDescCount = 0;
-        DescriptorCount dsvDescCount = 0;
+
+        // usages of each state track with merged states
+        std::vector<TempRscNode> trackTempNodes;
+
+        // descs recreated in each frame
+        DescriptorIndices frameDescCount;
+
+        // descs created once with the graph
+        DescriptorIndices graphDescCount;
     };
 
     struct PassRscStates
@@ -134,39 +298,232 @@ private:
         D3D12_RESOURCE_STATES afterState;
     };
 
+    struct TransientRscPlacement
+    {
+        // index of shared heap. -1 means the rsc has its own memory
+        int heapIdx = -1;
+        UINT64 offset = 0;
+
+        // whether the rsc overlaps with other rscs in memory
+        bool aliased = false;
+    };
+
+    struct TransientHeap
+    {
+        D3D12_HEAP_FLAGS heapFlags = D3D12_HEAP_FLAG_NONE;
+
+        // holds backbuffer-relative rscs only. other rscs never share
+        // memory with them, so that they can be resized separately
+        bool relative = false;
+
+        UINT64 byteSize  = 0;
+        UINT64 alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+    };
+
+    struct TransientCandidate
+    {
+        size_t rscIdx;
+
+        // lifetime: [firstPass, lastPass]
+        int32_t firstPass;
+        int32_t lastPass;
+
+        D3D12_RESOURCE_ALLOCATION_INFO allocInfo;
+    };
+
+    struct TransientMemoryInfo
+    {
+        std::vector<TransientRscPlacement> placements;
+        std::vector<TransientHeap>         heaps;
+
+        UINT64 byteSizeBeforeAliasing = 0;
+        UINT64 byteSizeAfterAliasing  = 0;
+
+        UINT64 relativeByteSizeBeforeAliasing = 0;
+    };
+
+    // allocate rscs of history rings, with flags & the state between
+    // frames inferred from their usages
+    void createHistoryRings(
+        FrameGraphData    &graph,
+        ResourceAllocator &rscAlloc,
+        ResourceReleaser  &rscReleaser,
+        ResourceReleaser  &relativeRscReleaser);
+
+    static void allocHistoryRing(
+        FrameGraphHistoryRing &ring,
+        ResourceAllocator     &rscAlloc,
+        ResourceReleaser      &rscReleaser);
+
+    static void bindHistoryRing(
+        FrameGraphData &graph, const FrameGraphHistoryRing &ring);
+
+    // partition subresources of each rsc into state tracks by the usages
+    // covering them, and fill tracks of each usage
+    void createStateTracks();
+
+    // remove passes contributing to neither external rscs nor side effects
+    void cullPasses(FrameGraphCompileStatistics &statistics);
+
+    // topologically sort passes by read/write dependencies
+    void reorderPasses(FrameGraphCompileStatistics &statistics);
+
+    // put async compute/copy passes on the compute/copy queue if all their
+    // transitions can be recorded in cmd lists of the queue
+    void assignQueues(
+        const FrameGraphCompileOptions &options,
+        FrameGraphCompileStatistics    &statistics);
+
     void inferRscCreationFlagAndClearValue(
         CompilerPassNode::RscInPass &rscUsage);
 
     RscUsageInfo collectRscUsages();
 
+    // srv/uav descs of a pass are allocated contiguously and may be
+    // bound as a single table, so they are either all persistent or
+    // all recreated in each frame
+    bool hasPersistentGPUDescs(const CompilerPassNode &pass) const;
+
+    D3D12_RESOURCE_STATES getRscInitialState(size_t rscIdx) const;
+
+    D3D12_RESOURCE_STATES getRscFinalState(size_t rscIdx) const;
+
+    // throw if a subresource is used with different states in a pass
+    void checkTrackStatesInPasses(
+        const std::vector<TempRscNode> &trackTempNodes) const;
+
+    // a transition between users on different queues is recorded at the end
+    // of the previous user if its queue supports the new state, as
+    // non-graphics cmd lists support only part of the states
+    bool isTransitionHandedOff(
+        const TempRscNode &tempNode, size_t userIdx) const;
+
+    // whether uav accesses of the previous user must complete before the
+    // user. the previous user is inside the graph if userIdx > 0
+    bool isUAVBarrierNeeded(
+        const TempRscNode &tempNode, size_t userIdx) const;
+
+    // derive cross-queue waits & signals from rsc usages
+    std::vector<FrameGraphPassSync> computePassSyncs(
+        const std::vector<TempRscNode> &trackTempNodes,
+        FrameGraphCompileStatistics    &statistics) const;
+
+    // whether pass node b can be recorded in the render pass or rt/ds
+    // binding of its previous pass node a
+    static bool canMergePasses(
+        const FrameGraphPassNode &a, const FrameGraphPassSync &syncA,
+        const FrameGraphPassNode &b, const FrameGraphPassSync &syncB);
+
+    // mark runs of mergeable pass nodes. ending accesses of the render
+    // pass are taken from the last node of each run
+    static void mergePasses(FrameGraphData &graph);
+
+    static D3D12_HEAP_FLAGS getTransientHeapFlags(
+        const D3D12_RESOURCE_DESC &desc) noexcept;
+
+    // internal rsc whose content is always overwritten by the first users
+    // of its subresources in each frame, so its memory can be shared with
+    // rscs of disjoint lifetime
+    bool isTransientRsc(
+        size_t                          rscIdx,
+        const RscUsageInfo             &usageInfo) const;
+
+    TransientMemoryInfo planTransientMemory(
+        const RscUsageInfo             &usageInfo,
+        const ResourceAllocator        &rscAlloc) const;
+
+    // pack candidates of disjoint lifetimes into the same heap.
+    // placements are indexed by rscIdx of candidates
+    static void packTransientHeap(
+        std::vector<TransientCandidate>     &candidates,
+        int                                  heapIdx,
+        std::vector<TransientRscPlacement>  &placements,
+        TransientHeap                       &heap);
+
+    // rt/ds activated by an aliasing barrier must be initialized by
+    // clearing, discarding or copying into it before the first usage of
+    // its subresources. resolving into it does not count as initialization
+    static bool isDiscardNeeded(
+        const FrameGraphPassNode::PassResource::RTDSBinding &rtdsBinding,
+        D3D12_RESOURCE_STATES                                inState,
+        D3D12_RESOURCE_FLAGS                                 rscFlags);
+
+    // format of the rsc. unknown for unset external rscs
+    DXGI_FORMAT getRscFormat(size_t rscIdx) const;
+
+    // whether the usage clears or overwrites all content of its
+    // subresources: clearing rt/ds, copying or resolving into them,
+    // or uav declared with UAVOverwrite
+    static bool isOverwritingUsage(
+        const CompilerPassNode::RscInPass &rscUsage,
+        DXGI_FORMAT                        rscFormat);
+
+    // whether the first user of a state track in each frame overwrites
+    // all its content. otherwise the content of the previous frame is
+    // carried into the next one
+    bool isOverwrittenByFirstUser(
+        int32_t            track,
+        const TempRscNode &tempTrack) const;
+
+    // rt/ds can only be discarded as rt, ds or uav. other first usages
+    // are discarded in a temporary rt/ds state
+    static D3D12_RESOURCE_STATES getDiscardState(
+        D3D12_RESOURCE_STATES inState,
+        D3D12_RESOURCE_FLAGS  rscFlags) noexcept;
+
+    // beginning accesses of rt/ds binding, which depend on the discard
+    // flag of the pass rsc
+    static void updateBeginAccess(
+        FrameGraphPassNode::PassResource &passRsc) noexcept;
+
     FrameGraphResourceNode createD3DRscNode(
         const CompilerResourceNode &cn,
         ResourceAllocator &rscAlloc,
         ResourceReleaser &rscReleaser) const;
 
+    FrameGraphResourceNode createPlacedD3DRscNode(
+        const CompilerInternalResourceNode &in,
+        D3D12MA::Allocation                *memory,
+        UINT64                              offset,
+        ResourceAllocator                  &rscAlloc,
+        ResourceReleaser                   &rscReleaser) const;
+
     PassRscStates getPassRscStates(
-        const CompilerPassNode::RscInPass &rscUsage,
-        const CompilerResourceNode &rscNode,
-        const TempRscNode &tempNode) const;
+        size_t             rscIdx,
+        const TempRscNode &trackTempNode,
+        int                idxInTrackUsers) const;
 
     void inferDescFormat(
         CompilerPassNode::RscInPass &rscUsage, ID3D12Resource *d3dRsc) const;
 
-    FrameGraphPassNode::PassViewport inferDefaultViewportAndScissor(
-        const CompilerPassNode::RscInPass::ViewDesc *view,
-        const std::vector<FrameGraphResourceNode> &rscNodes);
+    static FrameGraphPassNode::PassViewport inferDefaultViewportAndScissor(
+        const D3D12_RESOURCE_DESC &rtdsDesc);
 
+    static std::string getPassName(const CompilerPassNode &pass);
+
+    // pass rsc of the trackIdx-th state track covered by rscUsage.
+    // only the first one has the view and rt/ds binding
     FrameGraphPassNode::PassResource createFinalPassResource(
         CompilerPassNode::RscInPass                  &rscUsage,
-        const std::vector<TempRscNode>               &rscTempNodes,
+        size_t                                        trackIdx,
+        const RscUsageInfo                           &usageInfo,
+        const std::vector<TransientRscPlacement>     &rscPlacements,
         const std::vector<FrameGraphResourceNode>    &rscNodes,
-        DescriptorIndex                              &gpuDescIdx,
-        DescriptorIndex                              &rtvDescIdx,
-        DescriptorIndex                              &dsvDescIdx,
+        bool                                          persistentGPUDescs,
+        DescriptorIndices                            &frameDescIdx,
+        DescriptorIndices                            &graphDescIdx,
         const CompilerPassNode::RscInPass::ViewDesc *&rtdsView);
 
     std::vector<CompilerPassNode>     passes_;
     std::vector<CompilerResourceNode> rscs_;
+    std::vector<CompilerHistoryRing>  historyRings_;
+
+    // tracks of rsc r are [rscTrackOffsets_[r], rscTrackOffsets_[r + 1])
+    std::vector<StateTrack> tracks_;
+    std::vector<int32_t>    rscTrackOffsets_;
+
+    UINT backbufferWidth_  = 0;
+    UINT backbufferHeight_ = 0;
 };
 
 namespace detail
@@ -235,14 +592,26 @@ namespace detail
         FrameGraphCompiler::CompilerPassNode &passNode,
         const DepthStencilBinding &dsb)
     {
-        // IMPROVE: optimize for read-only usage
         FrameGraphCompiler::CompilerPassNode::RscInPass rsc;
-        rsc.idx      = dsb.dsv.rsc;
-        rsc.inState  = D3D12_RESOURCE_STATE_DEPTH_WRITE;
-        rsc.viewDesc = dsb.dsv;
+        rsc.idx = dsb.dsv.rsc;
+
+        // READ_ONLY_STENCIL is added after the dsv format is inferred
+
+        _internalDSV dsv = dsb.dsv;
+        if(dsb.readOnly)
+        {
+            rsc.inState     = D3D12_RESOURCE_STATE_DEPTH_READ;
+            dsv.desc.Flags |= D3D12_DSV_FLAG_READ_ONLY_DEPTH;
+        }
+        else
+            rsc.inState = D3D12_RESOURCE_STATE_DEPTH_WRITE;
+        rsc.viewDesc = dsv;
 
         rsc.rtdsBinding = FrameGraphPassNode::PassResource::DSB
-            { dsb.clearDepth, dsb.clearStencil, dsb.clearDepthStencilValue };
+        {
+            dsb.clearDepth, dsb.clearStencil,
+            dsb.clearDepthStencilValue, dsb.readOnly
+        };
 
         passNode.rscs.push_back(rsc);
     }
@@ -277,6 +646,34 @@ namespace detail
         passNode.scissors.push_back(scissor);
     }
 
+    inline void _initCompilerRP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        const _internalSideEffect &)
+    {
+        passNode.hasSideEffect = true;
+    }
+
+    inline void _initCompilerRP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        const _internalStaticPass &)
+    {
+        passNode.isStatic = true;
+    }
+
+    inline void _initCompilerRP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        const ParallelChunks &chunks)
+    {
+        passNode.chunkCount = (std::max)(chunks.chunkCount, 1u);
+    }
+
+    inline void _initCompilerRP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        PassName name)
+    {
+        passNode.name = std::move(name.name);
+    }
+
     inline void _initCompilerRP(
         FrameGraphCompiler::CompilerPassNode &passNode,
         ComPtr<ID3D12PipelineState> pipelineState)
@@ -313,6 +710,34 @@ namespace detail
         passNode.rscs.push_back(rsc);
     }
     
+    inline void _initCompilerCP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        const _internalSideEffect &)
+    {
+        passNode.hasSideEffect = true;
+    }
+
+    inline void _initCompilerCP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        PassName name)
+    {
+        passNode.name = std::move(name.name);
+    }
+
+    inline void _initCompilerCP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        const ParallelChunks &chunks)
+    {
+        passNode.chunkCount = (std::max)(chunks.chunkCount, 1u);
+    }
+
+    inline void _initCompilerCP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        const _internalAsyncCompute &)
+    {
+        passNode.isAsyncCompute = true;
+    }
+
     inline void _initCompilerCP(
         FrameGraphCompiler::CompilerPassNode &passNode,
         ComPtr<ID3D12PipelineState> pipelineState)
@@ -327,6 +752,40 @@ namespace detail
         passNode.rootSignature = std::move(rootSignature);
     }
 
+    inline void _initCompilerCopyP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        const CopySource &src)
+    {
+        FrameGraphCompiler::CompilerPassNode::RscInPass rsc;
+        rsc.idx     = src.rsc;
+        rsc.inState = D3D12_RESOURCE_STATE_COPY_SOURCE;
+        passNode.rscs.push_back(rsc);
+    }
+
+    inline void _initCompilerCopyP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        const CopyDest &dst)
+    {
+        FrameGraphCompiler::CompilerPassNode::RscInPass rsc;
+        rsc.idx     = dst.rsc;
+        rsc.inState = D3D12_RESOURCE_STATE_COPY_DEST;
+        passNode.rscs.push_back(rsc);
+    }
+
+    inline void _initCompilerCopyP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        const _internalSideEffect &)
+    {
+        passNode.hasSideEffect = true;
+    }
+
+    inline void _initCompilerCopyP(
+        FrameGraphCompiler::CompilerPassNode &passNode,
+        PassName name)
+    {
+        passNode.name = std::move(name.name);
+    }
+
 } // namespace detail
 
 template<typename ... Args>
@@ -337,6 +796,7 @@ PassIndex FrameGraphCompiler::addGraphicsPass(
     passes_.emplace_back();
     auto &newPass = passes_.back();
 
+    newPass.index      = { idx };
     newPass.isGraphics = true;
     newPass.passFunc   = std::move(passFunc);
 
@@ -356,6 +816,7 @@ PassIndex FrameGraphCompiler::addComputePass(
     passes_.emplace_back();
     auto &newPass = passes_.back();
 
+    newPass.index      = { idx };
     newPass.isGraphics = false;
     newPass.passFunc   = std::move(passFunc);
 
@@ -367,4 +828,25 @@ PassIndex FrameGraphCompiler::addComputePass(
     return { idx };
 }
 
+template<typename ... Args>
+PassIndex FrameGraphCompiler::addCopyPass(
+    FrameGraphPassFunc passFunc, Args &&... args)
+{
+    const auto idx = static_cast<int32_t>(passes_.size());
+    passes_.emplace_back();
+    auto &newPass = passes_.back();
+
+    newPass.index      = { idx };
+    newPass.isGraphics = false;
+    newPass.isCopy     = true;
+    newPass.passFunc   = std::move(passFunc);
+
+    InvokeAll([&]
+    {
+        detail::_initCompilerCopyP(newPass, std::forward<Args>(args));
+    }...);
+
+    return { idx };
+}
+
 AGZ_D3D12_FG_END
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <agz/d3d12/framegraph/common.h>
+
+AGZ_D3D12_FG_BEGIN
+
+// read the rsc with copy commands (COPY_SOURCE)
+struct CopySource
+{
+    ResourceIndex rsc;
+};
+
+// write the rsc with copy commands (COPY_DEST)
+struct CopyDest
+{
+    ResourceIndex rsc;
+};
+
+AGZ_D3D12_FG_END
@@ -2,6 +2,7 @@
 
 #include <agz/d3d12/framegraph/cmdListPool.h>
 #include <agz/d3d12/framegraph/graphData.h>
+#include <agz/d3d12/framegraph/profiler.h>
 #include <agz/d3d12/framegraph/scheduler.h>
 #include <agz/utility/thread.h>
 
@@ -16,13 +17,26 @@ public:
 
     void startFrame(int frameIndex);
 
+    void setTaskBatchingOptions(const FrameGraphTaskBatchingOptions &options);
+
+    void setProfilingOptions(const FrameGraphProfilingOptions &options);
+
+    const FrameGraphProfiler &getProfiler() const noexcept;
+
+    // num of state bindings skipped in the last executed graph
+    const FrameGraphStateFilterStatistics &
+        getStateFilterStatistics() const noexcept;
+
+    // num of transitions recorded as split barriers in the last executed graph
+    size_t getSplitBarrierCount() const noexcept;
+
     void execute(
-        ID3D12DescriptorHeap *gpuRawHeap,
-        FrameGraphData       &graph,
-        DescriptorRange       allGPUDescs,
-        DescriptorRange       allRTVDescs,
-        DescriptorRange       allDSVDescs,
-        ID3D12CommandQueue   *cmdQueue);
+        ID3D12DescriptorHeap      *gpuRawHeap,
+        FrameGraphData            &graph,
+        DescriptorRange            allGPUDescs,
+        DescriptorRange            allRTVDescs,
+        DescriptorRange            allDSVDescs,
+        const FrameGraphCmdQueues &cmdQueues);
 
 private:
 
@@ -33,7 +47,17 @@ private:
 
     CommandListPool cmdListPool_;
 
+    FrameGraphTaskScheduler scheduler_;
+    // serializes scheduler calls when lock-free submission is disabled
     std::mutex schedulerMutex_;
+
+    FrameGraphProfiler profiler_;
+
+    std::vector<FrameGraphStateFilterStatistics> threadStateFilterStats_;
+    FrameGraphStateFilterStatistics              stateFilterStats_;
+
+    std::vector<size_t> threadSplitBarrierCounts_;
+    size_t              splitBarrierCount_;
 };
 
 AGZ_D3D12_FG_END
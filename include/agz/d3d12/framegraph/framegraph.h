@@ -1,8 +1,11 @@
 #pragma once
 
+#include <list>
+
 #include <agz/d3d12/framegraph/compiler.h>
 #include <agz/d3d12/framegraph/executer.h>
 #include <agz/d3d12/framegraph/graphData.h>
+#include <agz/d3d12/framegraph/report.h>
 
 AGZ_D3D12_FG_BEGIN
 
@@ -62,24 +65,175 @@ public:
         D3D12_RESOURCE_STATES        initialState,
         D3D12_RESOURCE_STATES        finalState);
 
+    /**
+     * @brief add a ring of historyLength rscs whose contents are kept
+     *  across frames
+     *
+     * ret[0] is written in the current frame, and ret[k] is the one
+     * written k frames ago. the ring is rotated after each execute without
+     * reallocation. rscs of the ring stay in the state of the last usage of
+     * ret[0] between frames, and are created with flags required by all
+     * usages. contents are undefined until written, including after the
+     * graph is resized.
+     */
+    HistoryResourceIndex addHistoryResource(
+        const RscDesc &rscDesc, int32_t historyLength);
+
     template<typename...Args>
     PassIndex addGraphicsPass(FrameGraphPassFunc passFunc, Args &&...args);
 
     template<typename...Args>
     PassIndex addComputePass(FrameGraphPassFunc passFunc, Args &&...args);
 
+    /**
+     * @brief add a pass recording copy commands only
+     *
+     * rscs are declared with CopySource/CopyDest. the pass is submitted to
+     * the copy queue (if any), and its cmd list has no descriptor heap.
+     */
+    template<typename...Args>
+    PassIndex addCopyPass(FrameGraphPassFunc passFunc, Args &&...args);
+
+    /**
+     * @brief add a pass resolving multisampled src into dst
+     *
+     * mip 0 of each array slice is resolved on the graphics queue. states
+     * of both rscs are tracked by the graph, and internal ones may share
+     * transient memory like rscs of other passes. format is inferred from
+     * dst, or from src if dst is typeless.
+     */
+    PassIndex addResolvePass(
+        ResourceIndex src,
+        ResourceIndex dst,
+        PassName      name   = {},
+        DXGI_FORMAT   format = DXGI_FORMAT_UNKNOWN);
+
     void reset();
 
+    void setCompileOptions(const FrameGraphCompileOptions &options);
+
+    void setTaskBatchingOptions(const FrameGraphTaskBatchingOptions &options);
+
+    /**
+     * @brief measure cpu & gpu time of each pass
+     *
+     * gpu timestamps are read back when the frame index is reused, so
+     * results lag behind by frameCount frames. passes are identified by
+     * PassName. resets collected results.
+     */
+    void setProfilingOptions(const FrameGraphProfilingOptions &options);
+
+    /**
+     * @brief rolling min/avg/p99 time of each pass in the latest frames
+     */
+    std::vector<FrameGraphPassProfile> getPassProfiles() const;
+
+    /**
+     * @brief passes in the latest frames in chrome trace json format
+     */
+    std::string exportChromeTrace() const;
+
+    /**
+     * @brief set the queue for passes marked with ASYNC_COMPUTE
+     *
+     * must be a compute queue on the same device. without it, async compute
+     * passes are submitted to the graphics queue.
+     * takes effect in the next compile.
+     */
+    void setAsyncComputeQueue(ID3D12CommandQueue *computeQueue);
+
+    /**
+     * @brief set the queue for copy passes
+     *
+     * must be a copy queue on the same device. without it, copy passes are
+     * submitted to the graphics queue.
+     * takes effect in the next compile.
+     */
+    void setCopyQueue(ID3D12CommandQueue *copyQueue);
+
+    /**
+     * @brief max num of compiled graphs kept, including the active one
+     *
+     * compiling a graph whose structure matches a kept one reuses it,
+     * which skips both compilation and rsc allocation.
+     * default value is 1, which means only the active graph is kept.
+     */
+    void setGraphCacheCapacity(size_t capacity);
+
+    /**
+     * @brief max byte size of freed internal rscs kept for reuse
+     *
+     * rscs of retired graphs are returned to the pool once gpu has finished
+     * with them, and reused by later compiled graphs with matching descs.
+     * default value is 256MB. 0 disables pooling.
+     */
+    void setResourcePoolCapacity(UINT64 byteSize);
+
     void compile();
 
+    const FrameGraphCompileStatistics &getCompileStatistics() const noexcept;
+
+    /**
+     * @brief passes, rsc lifetimes, barriers, descriptor counts and memory
+     *  of the active graph
+     *
+     * serialize it with toJSON or toGraphvizDOT
+     */
+    FrameGraphReport getReport() const;
+
+    size_t getGraphCacheHitCount() const noexcept;
+
+    size_t getGraphCacheMissCount() const noexcept;
+
+    const ResourcePoolStatistics &getResourcePoolStatistics() const noexcept;
+
+    // redundant state bindings skipped in the last executed frame
+    const FrameGraphStateFilterStatistics &
+        getStateFilterStatistics() const noexcept;
+
+    // transitions recorded as split barriers in the last executed frame.
+    // split candidates of the compiled graph whose producer and consumer
+    // were recorded into different cmd lists are not counted
+    size_t getSplitBarrierCount() const noexcept;
+
     void setExternalRsc(ResourceIndex idx, ComPtr<ID3D12Resource> rsc);
 
+    /**
+     * @brief drop all refs to external rscs
+     *
+     * call it before the swap chain is resized. external rscs of the active
+     * graph must be set again with setExternalRsc before the next execute.
+     */
+    void clearExternalResources();
+
+    /**
+     * @brief set the backbuffer size
+     *
+     * rscs declared with BackbufferRelativeSize are recreated with the new
+     * size, and default viewports/scissors inferred from them are updated.
+     * other rscs and the graph structure are untouched, so the active graph
+     * needs no recompilation. kept graphs are resized when reused.
+     * must be called before compiling graphs with backbuffer-relative rscs.
+     */
+    void resize(UINT width, UINT height);
+
+    /**
+     * @brief record and submit the active graph
+     *
+     * once the graph, cmd lists and per-frame descriptors are warmed up,
+     * buffers of the graph are reused and no heap allocation is made by
+     * this library. allocations may still come from the thread group of
+     * agz-utils, which wraps the worker func in a std::function, and from
+     * the d3d12 runtime & driver. sample 10 counts them
+     */
     void execute();
 
 private:
 
     ID3D12Device       *device_;
     ID3D12CommandQueue *cmdQueue_;
+    ID3D12CommandQueue *computeQueue_;
+    ID3D12CommandQueue *copyQueue_;
 
     DescriptorSubHeap subRTVHeap_;
     DescriptorSubHeap subDSVHeap_;
@@ -91,8 +245,60 @@ private:
 
     FrameGraphExecuter executer_;
 
+    FrameGraphCompileOptions compileOptions_;
+
+    UINT backbufferWidth_;
+    UINT backbufferHeight_;
+
     std::unique_ptr<FrameGraphCompiler> compiler_;
-    FrameGraphData graphData_;
+
+    struct CompiledGraph
+    {
+        size_t      structureHash = 0;
+        std::string structureKey;
+
+        // rscs owned by data. must be destroyed after data
+        std::unique_ptr<ResourceReleaser> rscReleaser;
+
+        // rscs depending on the backbuffer size & persistent descs,
+        // replaced when the graph is resized
+        std::unique_ptr<ResourceReleaser> relativeRscReleaser;
+
+        FrameGraphData data;
+    };
+
+    void retireCompiledGraph(CompiledGraph &graph);
+
+    void createPersistentDescriptors(
+        FrameGraphData &data, ResourceReleaser &rscReleaser);
+
+    void resizeCompiledGraph(CompiledGraph &graph);
+
+    // record bundles of static passes whose descs or states are changed
+    void recordBundles(FrameGraphData &data);
+
+    // most recently used graph is at the front.
+    // the active graph (if any) is always the front one
+    std::list<CompiledGraph> graphCache_;
+    size_t graphCacheCapacity_;
+
+    size_t graphCacheHitCount_;
+    size_t graphCacheMissCount_;
+
+    FrameGraphData *graphData_;
+
+    // per-frame descs of each frame index. reallocated only when a graph
+    // needs more of them
+
+    struct FrameDescriptorRanges
+    {
+        DescriptorRange rtv;
+        DescriptorRange dsv;
+        DescriptorRange gpu;
+    };
+
+    std::vector<FrameDescriptorRanges> frameDescRanges_;
+    int frameIndex_;
 };
 
 template<typename ... Args>
@@ -111,4 +317,12 @@ PassIndex FrameGraph::addComputePass(
         std::move(passFunc), std::forward<Args>(args)...);
 }
 
+template<typename ... Args>
+PassIndex FrameGraph::addCopyPass(
+    FrameGraphPassFunc passFunc, Args &&... args)
+{
+    return compiler_->addCopyPass(
+        std::move(passFunc), std::forward<Args>(args)...);
+}
+
 AGZ_D3D12_FG_END
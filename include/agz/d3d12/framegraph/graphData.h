@@ -1,10 +1,15 @@
 #pragma once
 
+#include <string>
+
 #include <agz/d3d12/descriptor/descriptorHeap.h>
 #include <agz/d3d12/framegraph/resourceView/depthStencilViewDesc.h>
 #include <agz/d3d12/framegraph/resourceView/renderTargetViewDesc.h>
 #include <agz/d3d12/framegraph/resourceView/shaderResourceViewDesc.h>
 #include <agz/d3d12/framegraph/resourceView/unorderedAccessViewDesc.h>
+#include <agz/d3d12/framegraph/resourceAllocator.h>
+#include <agz/d3d12/framegraph/resourceDesc.h>
+#include <agz/d3d12/framegraph/resourceReleaser.h>
 #include <agz/d3d12/framegraph/RTDSBinding.h>
 #include <agz/utility/misc.h>
 
@@ -19,6 +24,86 @@ using FrameGraphPassFunc = std::function<
         FrameGraphPassContext &
         )>;
 
+// passes recorded in the same command list: [beg, end)
+struct FrameGraphPassRange
+{
+    size_t beg = 0;
+    size_t end = 0;
+
+    bool contains(size_t passIdx) const noexcept
+    {
+        return beg <= passIdx && passIdx < end;
+    }
+};
+
+// part of a pass recorded into its own cmd list
+struct FrameGraphPassChunk
+{
+    uint32_t idx   = 0;
+    uint32_t count = 1;
+
+    bool isFirst() const noexcept { return idx == 0; }
+    bool isLast()  const noexcept { return idx + 1 == count; }
+};
+
+// num of binding calls skipped as the states are already bound
+struct FrameGraphStateFilterStatistics
+{
+    size_t pipelineStates = 0;
+    size_t rootSignatures = 0;
+    size_t renderTargets  = 0;
+    size_t viewports      = 0;
+    size_t scissors       = 0;
+
+    FrameGraphStateFilterStatistics &operator+=(
+        const FrameGraphStateFilterStatistics &rhs) noexcept;
+};
+
+// states bound to a cmd list by the passes recorded into it.
+// binding calls with the same arguments are skipped if filter is set
+struct FrameGraphCmdListStates
+{
+    bool filter = true;
+
+    ID3D12PipelineState *pipelineState         = nullptr;
+    ID3D12RootSignature *graphicsRootSignature = nullptr;
+    ID3D12RootSignature *computeRootSignature  = nullptr;
+
+    // render targets are unknown after render passes
+    bool renderTargetsBound = false;
+    UINT renderTargetCount  = 0;
+    D3D12_CPU_DESCRIPTOR_HANDLE
+        renderTargets[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT] = {};
+    bool hasDepthStencil = false;
+    D3D12_CPU_DESCRIPTOR_HANDLE depthStencil = {};
+
+    // owned by the pass node which bound them
+    const std::vector<D3D12_VIEWPORT> *viewports = nullptr;
+    const std::vector<D3D12_RECT>     *scissors  = nullptr;
+
+    FrameGraphStateFilterStatistics filtered;
+
+    // transitions recorded as split barriers, whose halves are both
+    // in the cmd list
+    size_t splitBarriers = 0;
+
+    // forget bound states, e.g. after a pass func changes them
+    void invalidate() noexcept;
+};
+
+// contiguous elements owned by FrameGraphData
+template<typename T>
+struct FrameGraphSlice
+{
+    T     *data = nullptr;
+    size_t size = 0;
+
+    T *begin() const noexcept { return data; }
+    T *end()   const noexcept { return data + size; }
+
+    T &operator[](size_t i) const noexcept { return data[i]; }
+};
+
 class FrameGraphResourceNode : public misc::uncopyable_t
 {
 public:
@@ -31,6 +116,11 @@ public:
 
     void setExternalResource(ComPtr<ID3D12Resource> d3dRsc);
 
+    // rscs of history rings are rotated every frame
+    void setHistoryResource(ComPtr<ID3D12Resource> d3dRsc);
+
+    bool isExternal() const noexcept;
+
     ID3D12Resource *getD3DResource() const noexcept;
 
 private:
@@ -52,6 +142,13 @@ public:
         D3D12_RESOURCE_STATES inState      = {};
         D3D12_RESOURCE_STATES afterState   = {};
 
+        // subresources the states apply to. empty means all subresources
+        FrameGraphSlice<UINT> subresources;
+
+        // states of other subresources covered by the view of the
+        // preceding pass rsc. has no view or binding
+        bool trackOnly = false;
+
         using ViewDesc = misc::variant_t<
             std::monostate,
             _internalSRV,
@@ -60,15 +157,65 @@ public:
             _internalDSV>;
         ViewDesc viewDesc;
 
+        // index in the graph desc range if persistentDesc,
+        // otherwise index in the per-frame desc range
         DescriptorIndex descIdx = 0;
         mutable Descriptor descriptor;
 
+        // descriptor is created once with the compiled graph
+        bool persistentDesc = false;
+
+        // uav barriers are issued once per rsc in a pass
+
+        // uav accesses of previous passes must complete before this pass
+        bool uavBarrier = false;
+
+        // uav accesses of this pass must complete before the rsc is used
+        // outside the graph
+        bool outUAVBarrier = false;
+
+        // transient memory aliasing
+
+        // the rsc shares memory with other rscs and becomes active in this pass
+        bool aliasingBarrier = false;
+
+        // first usage of the subresources in the frame
+        bool firstUse = false;
+
+        // the subresources must be discarded after activation.
+        // they are transitioned to inState after being discarded
+        // in discardState
+        bool discard = false;
+        D3D12_RESOURCE_STATES discardState = {};
+
+        // split barriers
+        // split barriers cannot span command lists. the full transition is
+        // used when the other half is recorded in another command list
+
+        // transition into inState began after this pass
+        int32_t splitBeginPass = -1;
+
+        // transition from inState to splitEndState ends before this pass
+        int32_t splitEndPass = -1;
+        D3D12_RESOURCE_STATES splitEndState = {};
+
         // render target & depth stencil binding
 
+        // access types are used when the pass is recorded as a render pass.
+        // pass*EndAccess is the ending access of this pass alone, while
+        // *EndAccess is the one of the last pass merged with it
+
         struct RTB
         {
             bool clear = false;
             ClearColor clearColor;
+
+            D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE beginAccess =
+                D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE;
+            D3D12_RENDER_PASS_ENDING_ACCESS_TYPE endAccess =
+                D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
+            D3D12_RENDER_PASS_ENDING_ACCESS_TYPE passEndAccess =
+                D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
         };
 
         struct DSB
@@ -76,6 +223,22 @@ public:
             bool clearDepth   = false;
             bool clearStencil = false;
             ClearDepthStencil clearDethpStencil;
+
+            bool readOnly = false;
+
+            D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE depthBeginAccess =
+                D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE;
+            D3D12_RENDER_PASS_ENDING_ACCESS_TYPE depthEndAccess =
+                D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
+            D3D12_RENDER_PASS_ENDING_ACCESS_TYPE depthPassEndAccess =
+                D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
+
+            D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE stencilBeginAccess =
+                D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE;
+            D3D12_RENDER_PASS_ENDING_ACCESS_TYPE stencilEndAccess =
+                D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
+            D3D12_RENDER_PASS_ENDING_ACCESS_TYPE stencilPassEndAccess =
+                D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
         };
 
         using RTDSBinding = misc::variant_t<std::monostate, RTB, DSB>;
@@ -89,20 +252,99 @@ public:
         std::vector<D3D12_RECT> scissors;
     };
 
+    // execution data sized at compile time.
+    // executing the pass never allocates
+    struct PassData
+    {
+        // sorted by rscIdx
+        FrameGraphSlice<PassResource> rscs;
+
+        // in barriers are recorded from the front,
+        // out barriers are recorded from the back
+        FrameGraphSlice<D3D12_RESOURCE_BARRIER> barriers;
+
+        FrameGraphSlice<D3D12_CPU_DESCRIPTOR_HANDLE> rtvHandles;
+
+        // record the pass between BeginRenderPass/EndRenderPass
+        bool renderPass = false;
+
+        // replay the pass func recorded into a bundle.
+        // barriers, clears & rt/ds binding are still recorded per frame
+        bool bundle = false;
+
+        // num of chunks recorded in parallel. see ParallelChunks
+        uint32_t chunkCount = 1;
+
+        // merged with adjacent passes binding the same rts/ds.
+        // merged passes are recorded in one cmd list, sharing a single
+        // render pass or rt/ds binding
+        bool mergedWithPrev = false;
+        bool mergedWithNext = false;
+    };
+
     // init as graphics node
     FrameGraphPassNode(
-        std::map<ResourceIndex, PassResource> rscs,
-        PassViewport                          passViewport,
-        FrameGraphPassFunc                    passFunc,
-        ComPtr<ID3D12PipelineState>           pipelineState,
-        ComPtr<ID3D12RootSignature>           rootSignature) noexcept;
+        PassData                    passData,
+        PassViewport                passViewport,
+        FrameGraphPassFunc          passFunc,
+        ComPtr<ID3D12PipelineState> pipelineState,
+        ComPtr<ID3D12RootSignature> rootSignature) noexcept;
 
     // init as compute node
     FrameGraphPassNode(
-        std::map<ResourceIndex, PassResource> rscs,
-        FrameGraphPassFunc                    passFunc,
-        ComPtr<ID3D12PipelineState>           pipelineState,
-        ComPtr<ID3D12RootSignature>           rootSignature) noexcept;
+        PassData                    passData,
+        FrameGraphPassFunc          passFunc,
+        ComPtr<ID3D12PipelineState> pipelineState,
+        ComPtr<ID3D12RootSignature> rootSignature) noexcept;
+
+    // create descriptors of rscs with persistentDesc
+    void createPersistentDescriptors(
+        ID3D12Device                              *device,
+        const std::vector<FrameGraphResourceNode> &rscNodes,
+        DescriptorRange                            graphGPUDescs,
+        DescriptorRange                            graphRTVDescs,
+        DescriptorRange                            graphDSVDescs);
+
+    // replace states which are not part of the graph structure,
+    // used when a compiled graph is reused
+    void rebind(
+        FrameGraphPassFunc          passFunc,
+        ComPtr<ID3D12PipelineState> pipelineState,
+        ComPtr<ID3D12RootSignature> rootSignature);
+
+    // replace default viewports/scissors after the rsc they are inferred
+    // from is resized
+    void updateDefaultViewport(
+        const PassViewport &inferred, bool viewport, bool scissor);
+
+    // the bundle must be recorded (again) before executing the pass
+    bool isBundleOutdated() const noexcept;
+
+    // record the pass func into a new bundle. the old one may still be
+    // used by gpu and is handed to rscReleaser
+    void recordBundle(
+        ID3D12Device                              *device,
+        ID3D12DescriptorHeap                      *gpuRawHeap,
+        const std::vector<FrameGraphResourceNode> &rscNodes,
+        ResourceReleaser                          &rscReleaser);
+
+    void releaseBundle(ResourceReleaser &rscReleaser);
+
+    // see PassData::mergedWithPrev
+    void setMergedPasses(bool withPrev, bool withNext) noexcept;
+
+    // create per-frame descriptors before chunks of the pass are recorded,
+    // as all of them read the descriptors
+    void createChunkDescriptors(
+        ID3D12Device                              *device,
+        const std::vector<FrameGraphResourceNode> &rscNodes,
+        DescriptorRange                            allGPUDescs,
+        DescriptorRange                            allRTVDescs,
+        DescriptorRange                            allDSVDescs) const;
+
+    bool isGraphics() const noexcept;
+
+    const PassData &getPassData() const noexcept;
 
     bool execute(
         ID3D12Device                        *device,
@@ -110,6 +352,10 @@ public:
         DescriptorRange                      allGPUDescs,
         DescriptorRange                      allRTVDescs,
         DescriptorRange                      allDSVDescs,
+        size_t                               passIdx,
+        FrameGraphPassRange                  cmdListPasses,
+        FrameGraphPassChunk                  chunk,
+        FrameGraphCmdListStates             &cmdListStates,
         ID3D12GraphicsCommandList           *cmdList) const;
 
 private:
@@ -121,13 +367,17 @@ private:
         DescriptorRange                      allGPUDescs,
         DescriptorRange                      allRTVDescs,
         DescriptorRange                      allDSVDescs,
+        size_t                               passIdx,
+        FrameGraphPassRange                  cmdListPasses,
+        FrameGraphPassChunk                  chunk,
+        FrameGraphCmdListStates             &cmdListStates,
         ID3D12GraphicsCommandList           *cmdList) const;
 
     friend class FrameGraphPassContext;
 
     bool isGraphics_;
 
-    std::map<ResourceIndex, PassResource> rscs_;
+    PassData data_;
 
     PassViewport viewport_;
 
@@ -135,6 +385,153 @@ private:
 
     ComPtr<ID3D12PipelineState> pipelineState_;
     ComPtr<ID3D12RootSignature> rootSignature_;
+
+    // recorded pass func of static pass
+
+    bool bundleOutdated_ = true;
+
+    ComPtr<ID3D12CommandAllocator>    bundleAllocator_;
+    ComPtr<ID3D12GraphicsCommandList> bundle_;
+};
+
+// queue assignment and cross-queue synchronization of a pass node.
+// waits are issued before the pass, signals after it
+struct FrameGraphPassSync
+{
+    FrameGraphPassSync() noexcept
+    {
+        for(auto &w : waitPasses)
+            w = -1;
+    }
+
+    FrameGraphQueue queue = FrameGraphQueue::Graphics;
+
+    // index of the pass node on queue q that must be finished before
+    // this pass starts. -1 means no waiting on queue q
+    int32_t waitPasses[FRAME_GRAPH_QUEUE_COUNT];
+
+    // wait until the graphics queue finishes the previous frame,
+    // which also covers other queues of the previous frame
+    bool waitPrevFrame = false;
+
+    // some pass on another queue waits for this one
+    bool signal = false;
+};
+
+struct FrameGraphCompileStatistics
+{
+    // dead pass culling
+
+    std::vector<PassIndex>     culledPasses;
+    std::vector<ResourceIndex> culledRscs;
+
+    // pass reordering. counted before barrier optimizations
+
+    size_t transitionsInDeclaredOrder = 0;
+    size_t transitionsInCompiledOrder = 0;
+
+    // transitions that may be split between producer and consumer passes.
+    // a candidate falls back to a full transition when the two passes are
+    // recorded into different cmd lists. transitions actually split in a
+    // frame are counted by FrameGraph::getSplitBarrierCount
+
+    size_t splitBarrierCandidateCount = 0;
+
+    // uav barriers
+
+    // barriers omitted by uav overlap policies, between usages in the
+    // same pass or on different queues, and between tracks of the same rsc
+    size_t elidedUAVBarrierCount = 0;
+
+    // barriers after the last uav usages of external rscs
+    size_t trailingUAVBarrierCount = 0;
+
+    // pass merging
+
+    // passes recorded in the render pass or rt/ds binding of the
+    // previous pass
+    size_t mergedPassCount = 0;
+
+    // transient memory aliasing
+
+    // total byte size of internal rscs when each of them has its own memory
+    UINT64 transientMemoryBeforeAliasing = 0;
+
+    // total byte size of heaps shared by internal rscs
+    UINT64 transientMemoryAfterAliasing = 0;
+
+    size_t aliasedRscCount = 0;
+
+    // async compute
+
+    // passes submitted to the async compute queue
+    size_t asyncComputePassCount = 0;
+
+    // passes marked as async but kept on the graphics queue
+    size_t demotedAsyncComputePassCount = 0;
+
+    // passes submitted to the copy queue
+    size_t copyQueuePassCount = 0;
+
+    // copy passes kept on the graphics queue
+    size_t demotedCopyPassCount = 0;
+
+    // cross-queue waits, including waits for the previous frame
+    size_t crossQueueWaitCount = 0;
+};
+
+// internal rsc whose size is relative to the backbuffer
+struct FrameGraphRelativeResource
+{
+    int32_t rscIdx = -1;
+
+    BackbufferRelativeSize size;
+
+    // with inferred flags & clear value
+    ResourceAllocator::ResourceDesc desc;
+    D3D12_RESOURCE_STATES initialState = {};
+
+    // lifetime in transient memory. -1 if the rsc has its own memory
+    int32_t firstPass = -1;
+    int32_t lastPass  = -1;
+
+    // pass rsc of the first user in FrameGraphData::passRscs
+    size_t firstPassRsc = 0;
+};
+
+// graph-owned ring of rscs kept across frames. rscNodes[firstRsc + k] is
+// bound to the rsc written k frames ago
+struct FrameGraphHistoryRing
+{
+    int32_t firstRsc = -1;
+
+    std::optional<BackbufferRelativeSize> relativeSize;
+
+    // with inferred flags
+    ResourceAllocator::ResourceDesc desc;
+
+    // state of all rscs in the ring between frames
+    D3D12_RESOURCE_STATES state = {};
+
+    std::vector<ComPtr<ID3D12Resource>> rscs;
+
+    // rotation index in [0, rscs.size())
+    size_t frame = 0;
+};
+
+// pass whose default viewport/scissor is inferred from a rsc which may be
+// resized (backbuffer-relative or external)
+struct FrameGraphInferredViewport
+{
+    size_t  passIdx = 0;
+    int32_t rscIdx  = -1;
+
+    bool viewport = false;
+    bool scissor  = false;
+
+    // size of the rsc when the viewport was inferred
+    UINT64 width  = 0;
+    UINT   height = 0;
 };
 
 struct FrameGraphData
@@ -142,9 +539,45 @@ struct FrameGraphData
     std::vector<FrameGraphPassNode>     passNodes;
     std::vector<FrameGraphResourceNode> rscNodes;
 
+    // declaration index of each pass node
+    std::vector<PassIndex> passDeclIndices;
+
+    // name of each pass node. not part of the graph structure
+    std::vector<std::string> passNames;
+
+    // queue & cross-queue synchronization of each pass node
+    std::vector<FrameGraphPassSync> passSyncs;
+
+    // flat execution data. each pass node refers to slices of them
+    std::vector<FrameGraphPassNode::PassResource> passRscs;
+    std::vector<UINT>                             passSubresources;
+    std::vector<D3D12_RESOURCE_BARRIER>           passBarriers;
+    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE>      passRTVHandles;
+
+    // descs of views on external rscs, created in each frame
     DescriptorIndex gpuDescCount = 0;
     DescriptorIndex rtvDescCount = 0;
     DescriptorIndex dsvDescCount = 0;
+
+    // descs of views on internal rscs, created once with the graph
+    DescriptorIndex graphGPUDescCount = 0;
+    DescriptorIndex graphRTVDescCount = 0;
+    DescriptorIndex graphDSVDescCount = 0;
+
+    // backbuffer size the graph is compiled/resized for
+    UINT backbufferWidth  = 0;
+    UINT backbufferHeight = 0;
+
+    std::vector<FrameGraphRelativeResource> relativeRscs;
+    std::vector<FrameGraphInferredViewport> inferredViewports;
+
+    std::vector<FrameGraphHistoryRing> historyRings;
+
+    // transient memory of backbuffer-relative rscs
+    UINT64 relativeTransientMemoryBeforeAliasing = 0;
+    UINT64 relativeTransientMemoryAfterAliasing  = 0;
+
+    FrameGraphCompileStatistics statistics;
 };
 
 AGZ_D3D12_FG_END
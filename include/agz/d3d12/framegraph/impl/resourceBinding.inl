@@ -46,6 +46,12 @@ namespace detail
         dsb.dsv = dsv;
     }
 
+    inline void _initDSB(
+        DepthStencilBinding &dsb, const _internalReadOnlyDepthStencil &) noexcept
+    {
+        dsb.readOnly = true;
+    }
+
 } // namespace detail
 
 template<typename ... Args>
@@ -59,9 +65,11 @@ RenderTargetBinding::RenderTargetBinding(
 template<typename ... Args>
 DepthStencilBinding::DepthStencilBinding(
     const Args &... args) noexcept
-    : dsv(RESOURCE_NIL), clearDepth(false), clearStencil(false)
+    : dsv(RESOURCE_NIL), clearDepth(false), clearStencil(false),
+      readOnly(false)
 {
     InvokeAll([&] { detail::_initDSB(*this, args); }...);
+    assert(!readOnly || (!clearDepth && !clearStencil));
 }
 
 AGZ_D3D12_FG_END
@@ -25,6 +25,18 @@ namespace detail
 
 } // namespace detail
 
+inline void resolveBackbufferRelativeSize(
+    D3D12_RESOURCE_DESC          &desc,
+    const BackbufferRelativeSize &size,
+    UINT                          backbufferWidth,
+    UINT                          backbufferHeight) noexcept
+{
+    desc.Width = (std::max)(
+        UINT64(1), static_cast<UINT64>(backbufferWidth * size.widthScale));
+    desc.Height = (std::max)(
+        UINT(1), static_cast<UINT>(backbufferHeight * size.heightScale));
+}
+
 template<typename ... Args>
 Tex2DDesc::Tex2DDesc(
     DXGI_FORMAT format, UINT w, UINT h,
@@ -44,6 +56,15 @@ Tex2DDesc::Tex2DDesc(
     InvokeAll([&] { detail::_initRscDesc(desc, args); }...);
 }
 
+template<typename ... Args>
+Tex2DDesc::Tex2DDesc(
+    DXGI_FORMAT format, const BackbufferRelativeSize &size,
+    const Args &... args) noexcept
+    : Tex2DDesc(format, 1, 1, args...)
+{
+    relativeSize = size;
+}
+
 template<typename ... Args>
 Tex2DArrDesc::Tex2DArrDesc(
     DXGI_FORMAT format, UINT w, UINT h, UINT arrSize,
@@ -63,6 +84,15 @@ Tex2DArrDesc::Tex2DArrDesc(
     InvokeAll([&] { detail::_initRscDesc(desc, args); }...);
 }
 
+template<typename ... Args>
+Tex2DArrDesc::Tex2DArrDesc(
+    DXGI_FORMAT format, const BackbufferRelativeSize &size, UINT arrSize,
+    const Args &... args) noexcept
+    : Tex2DArrDesc(format, 1, 1, arrSize, args...)
+{
+    relativeSize = size;
+}
+
 template<typename ... Args>
 BufDesc::BufDesc(size_t byteSize, const Args &... args) noexcept
 {
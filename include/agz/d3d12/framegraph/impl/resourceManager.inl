@@ -6,6 +6,7 @@ AGZ_D3D12_FG_BEGIN
 
 inline ResourceAllocator::ResourceAllocator(
     ID3D12Device *device, IDXGIAdapter *adaptor)
+    : device_(device), poolCapacity_(256 * 1024 * 1024)
 {
     D3D12MA::ALLOCATOR_DESC allocatorDesc = {};
     allocatorDesc.pDevice  = device;
@@ -19,13 +20,38 @@ inline ResourceAllocator::ResourceAllocator(
 inline ResourceAllocator::~ResourceAllocator()
 {
     for(auto &rsc : allocatedRscs_)
-        rsc.second->Release();
+        rsc.second.allocation->Release();
+    for(auto &rsc : pooledRscs_)
+        rsc.allocatedRsc.allocation->Release();
 }
 
 inline ComPtr<ID3D12Resource> ResourceAllocator::allocResource(
     const ResourceDesc    &desc,
     D3D12_RESOURCE_STATES  expectedInitialState)
 {
+    const PoolKey key = { desc, expectedInitialState };
+
+    // reuse pooled rsc
+
+    if(const auto it = pooledRscIndex_.find(key); it != pooledRscIndex_.end())
+    {
+        const auto poolIt = it->second;
+        pooledRscIndex_.erase(it);
+
+        auto ret = std::move(poolIt->rsc);
+        const auto allocatedRsc = poolIt->allocatedRsc;
+        pooledRscs_.erase(poolIt);
+
+        --poolStats_.pooledRscCount;
+        poolStats_.pooledByteSize -= allocatedRsc.allocation->GetSize();
+        ++poolStats_.hitCount;
+
+        allocatedRscs_[ret] = allocatedRsc;
+        return ret;
+    }
+
+    // create new rsc
+
     D3D12MA::ALLOCATION_DESC allocDesc = {};
     allocDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
 
@@ -38,7 +64,9 @@ inline ComPtr<ID3D12Resource> ResourceAllocator::allocResource(
             desc.clear ? &desc.clearValue : nullptr,
             &allocation, IID_PPV_ARGS(ret.GetAddressOf())));
 
-    allocatedRscs_[ret] = allocation;
+    ++poolStats_.missCount;
+
+    allocatedRscs_[ret] = { allocation, key };
     return ret;
 }
 
@@ -47,8 +75,108 @@ inline void ResourceAllocator::freeResource(
 {
     const auto it = allocatedRscs_.find(rsc);
     assert(it != allocatedRscs_.end());
-    it->second->Release();
+    const auto allocatedRsc = it->second;
     allocatedRscs_.erase(it);
+
+    const UINT64 byteSize = allocatedRsc.allocation->GetSize();
+    if(byteSize > poolCapacity_)
+    {
+        allocatedRsc.allocation->Release();
+        return;
+    }
+
+    pooledRscs_.push_back({ std::move(rsc), allocatedRsc });
+    pooledRscIndex_.insert({ allocatedRsc.key, std::prev(pooledRscs_.end()) });
+
+    ++poolStats_.pooledRscCount;
+    poolStats_.pooledByteSize += byteSize;
+
+    while(poolStats_.pooledByteSize > poolCapacity_)
+        evictPooledResource(pooledRscs_.begin());
+}
+
+inline void ResourceAllocator::setPoolCapacity(UINT64 byteSize)
+{
+    poolCapacity_ = byteSize;
+    while(poolStats_.pooledByteSize > poolCapacity_)
+        evictPooledResource(pooledRscs_.begin());
+}
+
+inline const ResourcePoolStatistics &
+    ResourceAllocator::getPoolStatistics() const noexcept
+{
+    return poolStats_;
+}
+
+inline void ResourceAllocator::evictPooledResource(PoolList::iterator it)
+{
+    auto [beg, end] = pooledRscIndex_.equal_range(it->allocatedRsc.key);
+    for(auto i = beg; i != end; ++i)
+    {
+        if(i->second == it)
+        {
+            pooledRscIndex_.erase(i);
+            break;
+        }
+    }
+
+    --poolStats_.pooledRscCount;
+    poolStats_.pooledByteSize -= it->allocatedRsc.allocation->GetSize();
+
+    it->allocatedRsc.allocation->Release();
+    pooledRscs_.erase(it);
+}
+
+inline D3D12_RESOURCE_ALLOCATION_INFO ResourceAllocator::getAllocationInfo(
+    const D3D12_RESOURCE_DESC &desc) const
+{
+    return device_->GetResourceAllocationInfo(0, 1, &desc);
+}
+
+inline D3D12MA::Allocation *ResourceAllocator::allocMemory(
+    UINT64           byteSize,
+    UINT64           alignment,
+    D3D12_HEAP_FLAGS heapFlags)
+{
+    // size of raw memory must be multiple of 64KB
+
+    constexpr UINT64 SIZE_ALIGN = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+    D3D12_RESOURCE_ALLOCATION_INFO allocInfo;
+    allocInfo.SizeInBytes = (byteSize + SIZE_ALIGN - 1) / SIZE_ALIGN * SIZE_ALIGN;
+    allocInfo.Alignment   = alignment;
+
+    D3D12MA::ALLOCATION_DESC allocDesc = {};
+    allocDesc.HeapType       = D3D12_HEAP_TYPE_DEFAULT;
+    allocDesc.ExtraHeapFlags = heapFlags;
+
+    D3D12MA::Allocation *allocation;
+    AGZ_D3D12_CHECK_HR(
+        d3d12MemAlloc_->AllocateMemory(&allocDesc, &allocInfo, &allocation));
+
+    return allocation;
+}
+
+inline void ResourceAllocator::freeMemory(D3D12MA::Allocation *memory)
+{
+    memory->Release();
+}
+
+inline ComPtr<ID3D12Resource> ResourceAllocator::allocPlacedResource(
+    D3D12MA::Allocation   *memory,
+    UINT64                 offset,
+    const ResourceDesc    &desc,
+    D3D12_RESOURCE_STATES  expectedInitialState)
+{
+    ComPtr<ID3D12Resource> ret;
+    AGZ_D3D12_CHECK_HR(
+        d3d12MemAlloc_->CreateAliasingResource(
+            memory, offset, &desc.desc,
+            expectedInitialState,
+            desc.clear ? &desc.clearValue : nullptr,
+            IID_PPV_ARGS(ret.GetAddressOf())));
+
+    return ret;
 }
 
 AGZ_D3D12_FG_END
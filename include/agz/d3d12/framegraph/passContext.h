@@ -20,17 +20,37 @@ public:
         const FrameGraphPassNode                  &passNode,
         DescriptorRange                            allGPUDescs,
         DescriptorRange                            allRTVDescs,
-        DescriptorRange                            allDSVDescs) noexcept;
+        DescriptorRange                            allDSVDescs,
+        FrameGraphPassChunk                        chunk) noexcept;
 
     Resource getResource(ResourceIndex index) const;
 
+    // the usageIdx-th usage of the rsc declared by the pass, e.g. when
+    // a pass reads & writes different subresources of the rsc
+    Resource getResource(ResourceIndex index, size_t usageIdx) const;
+
     void requestCmdListSubmission() noexcept;
 
     bool isCmdListSubmissionRequested() const noexcept;
 
+    // pipeline state, root signature, render targets, viewports and
+    // scissors are bound by the graph. with filterRedundantStates,
+    // binding the same ones again in the same cmd list is skipped.
+    // call this if the pass func binds any of them itself
+    void invalidateBoundStates() noexcept;
+
+    bool isBoundStatesInvalidated() const noexcept;
+
+    // chunk being recorded when the pass is declared with ParallelChunks.
+    // each chunk records about 1/count of the work of the pass
+    uint32_t getChunkIndex() const noexcept;
+
+    uint32_t getChunkCount() const noexcept;
+
 private:
 
     bool requestCmdListSubmission_;
+    bool boundStatesInvalidated_;
 
     const std::vector<FrameGraphResourceNode> &rscNodes_;
     const FrameGraphPassNode                  &passNode_;
@@ -38,6 +58,8 @@ private:
     DescriptorRange allGPUDescs_;
     DescriptorRange allRTVDescs_;
     DescriptorRange allDSVDescs_;
+
+    FrameGraphPassChunk chunk_;
 };
 
 AGZ_D3D12_FG_END
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+
+#include <agz/d3d12/framegraph/common.h>
+
+AGZ_D3D12_FG_BEGIN
+
+struct _internalSideEffect { };
+
+// passes are culled by the compiler if nothing they write contributes to
+// external rscs. mark a pass with SIDE_EFFECT to always keep it.
+constexpr _internalSideEffect SIDE_EFFECT = {};
+
+struct _internalAsyncCompute { };
+
+// compute passes marked with ASYNC_COMPUTE are submitted to the async
+// compute queue (if any) and may overlap with graphics passes.
+// a pass stays on the graphics queue if some rsc transition it needs
+// is not supported by compute cmd lists
+constexpr _internalAsyncCompute ASYNC_COMPUTE = {};
+
+struct _internalStaticPass { };
+
+// graphics passes marked with STATIC_PASS record the same commands in
+// every frame. the pass func is recorded into a bundle once the graph is
+// compiled, and the bundle is replayed in each frame. it is recorded
+// again when the graph is resized or the pipeline state/root signature
+// is changed. srvs/uavs of external rscs are not allowed, as their
+// descriptors are recreated in each frame
+constexpr _internalStaticPass STATIC_PASS = {};
+
+// graphics/compute passes declared with ParallelChunks are recorded by
+// up to chunkCount threads. the pass func is called once per chunk with
+// its own cmd list, on which rt/ds, viewports, scissors, pipeline state and
+// root signature are already set. FrameGraphPassContext::getChunkIndex
+// tells which part of the work a call records. barriers & clears are
+// recorded before the first chunk and after the last one, and chunks are
+// submitted in order. cannot be combined with STATIC_PASS
+struct ParallelChunks
+{
+    uint32_t chunkCount = 1;
+};
+
+// name of a pass, shown in profiling results.
+// unnamed passes are named by their declaration indices
+struct PassName
+{
+    std::string name;
+};
+
+AGZ_D3D12_FG_END
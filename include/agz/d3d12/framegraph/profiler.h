@@ -0,0 +1,167 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include <agz/d3d12/framegraph/cmdListPool.h>
+#include <agz/d3d12/framegraph/graphData.h>
+#include <agz/d3d12/framegraph/scheduler.h>
+
+AGZ_D3D12_FG_BEGIN
+
+struct FrameGraphProfilingOptions
+{
+    // measure cpu recording time & gpu execution time of each pass
+    bool enabled = false;
+
+    // num of latest frames included in pass statistics
+    size_t statisticsFrameCount = 120;
+
+    // num of latest frames kept for chrome trace export
+    size_t traceFrameCount = 8;
+};
+
+// rolling statistics of a pass, in microseconds.
+// gpu times of passes on the copy queue are not measured (-1)
+struct FrameGraphPassProfile
+{
+    std::string name;
+
+    FrameGraphQueue queue = FrameGraphQueue::Graphics;
+
+    size_t frameCount = 0;
+
+    float cpuMin = 0;
+    float cpuAvg = 0;
+    float cpuP99 = 0;
+
+    float gpuMin = -1;
+    float gpuAvg = -1;
+    float gpuP99 = -1;
+};
+
+// gpu timestamps of a frame are written into the query heap of its frame
+// slot, resolved into a readback buffer at the end of the frame and read
+// when the slot is reused, which is a few frames later
+class FrameGraphProfiler : public misc::uncopyable_t
+{
+public:
+
+    FrameGraphProfiler(ID3D12Device *device, int frameCount);
+
+    void setOptions(const FrameGraphProfilingOptions &options);
+
+    const FrameGraphProfilingOptions &getOptions() const noexcept;
+
+    // collect results of the frame which last used the slot
+    void startFrame(int frameIndex);
+
+    // prepare for recording passes of graph in the current frame
+    void beginExecution(
+        const FrameGraphData      &graph,
+        const FrameGraphCmdQueues &cmdQueues);
+
+    // called by the thread recording the pass. each pass is recorded by
+    // one thread, so no synchronization is needed
+    void beginPass(
+        size_t passIdx, int threadIndex,
+        ID3D12GraphicsCommandList *cmdList) noexcept;
+
+    void endPass(
+        size_t passIdx, ID3D12GraphicsCommandList *cmdList) noexcept;
+
+    // resolve timestamps of the current frame after all passes are submitted
+    void endExecution(CommandListPool &cmdListPool);
+
+    std::vector<FrameGraphPassProfile> getPassProfiles() const;
+
+    // passes of the kept frames in chrome trace event format.
+    // can be loaded by chrome://tracing
+    std::string exportChromeTrace() const;
+
+private:
+
+    struct PassRecord
+    {
+        FrameGraphQueue queue = FrameGraphQueue::Graphics;
+
+        int threadIndex = 0;
+
+        // qpc ticks
+        INT64 cpuBeg = 0;
+        INT64 cpuEnd = 0;
+    };
+
+    struct FrameSlot
+    {
+        bool pending = false;
+
+        std::vector<std::string> passNames;
+        std::vector<PassRecord>  passRecords;
+
+        ComPtr<ID3D12QueryHeap> queryHeap;
+        ComPtr<ID3D12Resource>  readbackBuffer;
+        size_t                  queryCapacity = 0;
+
+        // gpu & cpu timestamps sampled at the same moment on each queue
+        bool   hasQueue[FRAME_GRAPH_QUEUE_COUNT] = {};
+        UINT64 gpuFrequency[FRAME_GRAPH_QUEUE_COUNT] = {};
+        UINT64 gpuCalibration[FRAME_GRAPH_QUEUE_COUNT] = {};
+        UINT64 cpuCalibration[FRAME_GRAPH_QUEUE_COUNT] = {};
+    };
+
+    struct PassHistory
+    {
+        FrameGraphQueue queue = FrameGraphQueue::Graphics;
+
+        // index of the pass node when the pass is last seen
+        size_t passIdx = 0;
+        size_t lastFrame = 0;
+
+        // rings of the latest samples
+        std::vector<float> cpuTimes;
+        std::vector<float> gpuTimes;
+        size_t nextSample = 0;
+    };
+
+    struct TraceEvent
+    {
+        std::string name;
+
+        // thread index for cpu events, queue for gpu events
+        bool gpu = false;
+        int  tid = 0;
+
+        // microseconds since the profiler is created
+        double ts  = 0;
+        double dur = 0;
+    };
+
+    void collectFrame(FrameSlot &slot);
+
+    void addSample(
+        const std::string &name, FrameGraphQueue queue, size_t passIdx,
+        float cpuTime, float gpuTime);
+
+    double qpcToMicroseconds(INT64 qpc) const noexcept;
+
+    ID3D12Device *device_;
+
+    FrameGraphProfilingOptions options_;
+
+    INT64 qpcFrequency_;
+    INT64 qpcEpoch_;
+
+    std::vector<FrameSlot> frameSlots_;
+    FrameSlot *currentSlot_;
+
+    ID3D12CommandQueue *graphicsQueue_;
+
+    size_t collectedFrameCount_;
+    std::map<std::string, PassHistory> passHistories_;
+
+    std::deque<std::vector<TraceEvent>> traceFrames_;
+};
+
+AGZ_D3D12_FG_END
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <string>
+
+#include <agz/d3d12/framegraph/graphData.h>
+
+AGZ_D3D12_FG_BEGIN
+
+// a barrier recorded before or after a pass node.
+// split barriers are listed as compiled. when both halves end up in
+// different cmd lists, the full transition is recorded instead
+struct FrameGraphReportBarrier
+{
+    enum class Type
+    {
+        Transition,
+        SplitBegin,
+        SplitEnd,
+        Aliasing,
+        UAV
+    };
+
+    Type type = Type::Transition;
+
+    int32_t rscIdx = -1;
+
+    D3D12_RESOURCE_STATES beforeState = {};
+    D3D12_RESOURCE_STATES afterState  = {};
+
+    // transitions of partially used rscs are per subresource
+    UINT subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+};
+
+struct FrameGraphReportPassResource
+{
+    int32_t rscIdx = -1;
+
+    // "srv", "uav", "rtv", "dsv" or "" (copy)
+    std::string view;
+
+    D3D12_RESOURCE_STATES inState = {};
+};
+
+struct FrameGraphReportPass
+{
+    std::string name;
+
+    // index in declaration order
+    int32_t declIdx = -1;
+
+    bool isGraphics = false;
+
+    FrameGraphPassSync sync;
+
+    std::vector<FrameGraphReportPassResource> rscs;
+
+    std::vector<FrameGraphReportBarrier> beforeBarriers;
+    std::vector<FrameGraphReportBarrier> afterBarriers;
+};
+
+struct FrameGraphReportResource
+{
+    int32_t idx = -1;
+
+    bool isExternal = false;
+
+    // internal rsc used by no pass
+    bool isCulled = false;
+
+    // shares transient memory with other rscs
+    bool isAliased = false;
+
+    bool isBackbufferRelative = false;
+
+    // index of the history ring containing the rsc. -1 if none
+    int32_t historyRing = -1;
+
+    D3D12_RESOURCE_DESC desc = {};
+
+    // size of memory required by the rsc. 0 if culled
+    UINT64 byteSize = 0;
+
+    // lifetime in pass node indices. -1 if unused
+    int32_t firstPass = -1;
+    int32_t lastPass  = -1;
+};
+
+// what compiling a frame graph produced, for inspecting redundant
+// transitions, descriptor usage and transient memory
+struct FrameGraphReport
+{
+    std::vector<FrameGraphReportPass>     passes;
+    std::vector<FrameGraphReportResource> rscs;
+
+    // per-frame descs of external rscs
+    DescriptorIndex gpuDescCount = 0;
+    DescriptorIndex rtvDescCount = 0;
+    DescriptorIndex dsvDescCount = 0;
+
+    // persistent descs of internal rscs
+    DescriptorIndex graphGPUDescCount = 0;
+    DescriptorIndex graphRTVDescCount = 0;
+    DescriptorIndex graphDSVDescCount = 0;
+
+    size_t transitionCount = 0;
+    // see FrameGraphCompileStatistics::splitBarrierCandidateCount
+    size_t splitBarrierCandidateCount = 0;
+    size_t aliasingBarrierCount = 0;
+    size_t uavBarrierCount = 0;
+
+    // sum of byteSize of internal rscs
+    UINT64 internalMemory = 0;
+
+    FrameGraphCompileStatistics statistics;
+};
+
+FrameGraphReport createFrameGraphReport(
+    ID3D12Device *device, const FrameGraphData &graph);
+
+std::string toJSON(const FrameGraphReport &report);
+
+// passes and rscs as nodes. edges go from rscs to passes reading them,
+// from passes to rscs they write, and between passes synchronized
+// across queues
+std::string toGraphvizDOT(const FrameGraphReport &report);
+
+AGZ_D3D12_FG_END
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <list>
 #include <map>
 
 #include <d3d12.h>
@@ -10,6 +11,19 @@
 
 AGZ_D3D12_FG_BEGIN
 
+struct ResourcePoolStatistics
+{
+    // allocResource calls served by pooled rscs
+    size_t hitCount = 0;
+
+    // allocResource calls creating new rscs
+    size_t missCount = 0;
+
+    // rscs currently kept in the pool
+    size_t pooledRscCount = 0;
+    UINT64 pooledByteSize = 0;
+};
+
 // no method is thread-safe
 class ResourceAllocator : public misc::uncopyable_t
 {
@@ -35,10 +49,70 @@ public:
         const ResourceDesc    &desc,
         D3D12_RESOURCE_STATES  expectedInitialState);
 
+    // the rsc must not be used by gpu anymore (see ResourceReleaser).
+    // it is kept in the pool for reuse if the pool capacity allows
     void freeResource(ComPtr<ID3D12Resource> rsc);
 
+    // max total byte size of pooled rscs. least recently freed rscs are
+    // destroyed first when exceeded. 0 disables pooling
+    void setPoolCapacity(UINT64 byteSize);
+
+    const ResourcePoolStatistics &getPoolStatistics() const noexcept;
+
+    D3D12_RESOURCE_ALLOCATION_INFO getAllocationInfo(
+        const D3D12_RESOURCE_DESC &desc) const;
+
+    // raw memory block in which placed resources can be created
+    D3D12MA::Allocation *allocMemory(
+        UINT64           byteSize,
+        UINT64           alignment,
+        D3D12_HEAP_FLAGS heapFlags);
+
+    void freeMemory(D3D12MA::Allocation *memory);
+
+    // the returned rsc doesn't own the memory.
+    // it holds a ref to the underlying heap and can be simply dropped
+    ComPtr<ID3D12Resource> allocPlacedResource(
+        D3D12MA::Allocation   *memory,
+        UINT64                 offset,
+        const ResourceDesc    &desc,
+        D3D12_RESOURCE_STATES  expectedInitialState);
+
 private:
 
+    // a freed rsc can be reused only if it has the same desc & clear value
+    // and was left in the state expected by the new user
+    struct PoolKey
+    {
+        ResourceDesc          desc;
+        D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COMMON;
+
+        bool operator<(const PoolKey &rhs) const noexcept
+        {
+            if(desc < rhs.desc)
+                return true;
+            if(rhs.desc < desc)
+                return false;
+            return state < rhs.state;
+        }
+    };
+
+    struct AllocatedRsc
+    {
+        D3D12MA::Allocation *allocation = nullptr;
+        PoolKey key;
+    };
+
+    struct PooledRsc
+    {
+        ComPtr<ID3D12Resource> rsc;
+        AllocatedRsc allocatedRsc;
+    };
+
+    using PoolList = std::list<PooledRsc>;
+
+    void evictPooledResource(PoolList::iterator it);
+
     struct D3D12MADeleter
     {
         void operator()(D3D12MA::Allocator *allocator) const
@@ -48,9 +122,18 @@ private:
         }
     };
 
+    ID3D12Device *device_;
+
     std::unique_ptr<D3D12MA::Allocator, D3D12MADeleter> d3d12MemAlloc_;
 
-    std::map<ComPtr<ID3D12Resource>, D3D12MA::Allocation*> allocatedRscs_;
+    std::map<ComPtr<ID3D12Resource>, AllocatedRsc> allocatedRscs_;
+
+    // pooled rscs from the least recently freed one
+    PoolList pooledRscs_;
+    std::multimap<PoolKey, PoolList::iterator> pooledRscIndex_;
+
+    UINT64 poolCapacity_;
+    ResourcePoolStatistics poolStats_;
 };
 
 AGZ_D3D12_FG_END
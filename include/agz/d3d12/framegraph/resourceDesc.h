@@ -1,5 +1,7 @@
 #pragma once
 
+#include <optional>
+
 #include <d3d12.h>
 
 #include <agz/d3d12/framegraph/common.h>
@@ -17,11 +19,30 @@ struct Multisample
     UINT quality = 0;
 };
 
+// texture size relative to the backbuffer size of the frame graph.
+// rscs declared with it are recreated by FrameGraph::resize
+struct BackbufferRelativeSize
+{
+    float widthScale  = 1;
+    float heightScale = 1;
+};
+
+constexpr BackbufferRelativeSize BACKBUFFER_SIZE = {};
+
 struct RscDesc
 {
     D3D12_RESOURCE_DESC desc = {};
+
+    // width & height in desc are derived from the backbuffer size if set
+    std::optional<BackbufferRelativeSize> relativeSize;
 };
 
+void resolveBackbufferRelativeSize(
+    D3D12_RESOURCE_DESC          &desc,
+    const BackbufferRelativeSize &size,
+    UINT                          backbufferWidth,
+    UINT                          backbufferHeight) noexcept;
+
 /**
  * - MipmapLevels. num of mipmap levels. default is 1
  * - Multisample. MS setting. default is { 1, 0 }
@@ -36,6 +57,11 @@ struct Tex2DDesc : RscDesc
     explicit Tex2DDesc(
         DXGI_FORMAT format, UINT w, UINT h,
         const Args &...args) noexcept;
+
+    template<typename...Args>
+    explicit Tex2DDesc(
+        DXGI_FORMAT format, const BackbufferRelativeSize &size,
+        const Args &...args) noexcept;
 };
 
 /**
@@ -52,6 +78,11 @@ struct Tex2DArrDesc : RscDesc
     explicit Tex2DArrDesc(
         DXGI_FORMAT format, UINT w, UINT h, UINT arrSize,
         const Args &...args) noexcept;
+
+    template<typename...Args>
+    explicit Tex2DArrDesc(
+        DXGI_FORMAT format, const BackbufferRelativeSize &size, UINT arrSize,
+        const Args &...args) noexcept;
 };
 
 /**
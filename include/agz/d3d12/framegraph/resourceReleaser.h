@@ -26,6 +26,17 @@ class ResourceReleaser
         ComPtr<ID3D12Resource> rsc;
     };
 
+    struct MemoryAllocRecord
+    {
+        void release()
+        {
+            rscAlloc->freeMemory(memory);
+        }
+
+        fg::ResourceAllocator *rscAlloc;
+        D3D12MA::Allocation   *memory;
+    };
+
     struct DescriptorRangeRecord
     {
         void release()
@@ -47,13 +58,21 @@ class ResourceReleaser
         std::unique_ptr<DescriptorHeap> heap;
     };
 
+    struct BundleRecord
+    {
+        ComPtr<ID3D12CommandAllocator>    allocator;
+        ComPtr<ID3D12GraphicsCommandList> bundle;
+    };
+
     struct Record
     {
         using Releaser = misc::variant_t<
             ObjRecord,
             RscAllocRecord,
+            MemoryAllocRecord,
             DescriptorRangeRecord,
-            DescriptorHeapRecord>;
+            DescriptorHeapRecord,
+            BundleRecord>;
 
         Releaser releaser;
         UINT64 expectedFenceValue = 0;
@@ -79,9 +98,20 @@ public:
     void add(
         ResourceAllocator &rscAlloc, ComPtr<ID3D12Resource> rsc);
 
+    void add(
+        ResourceAllocator &rscAlloc, D3D12MA::Allocation *memory);
+
     void add(DescriptorSubHeap &subheap, DescriptorRange range);
 
     void add(std::unique_ptr<DescriptorHeap> heap);
+
+    void add(
+        ComPtr<ID3D12CommandAllocator>    bundleAllocator,
+        ComPtr<ID3D12GraphicsCommandList> bundle);
+
+    // move all records of other into this releaser.
+    // they will be released after the next release point of this releaser
+    void takeRecordsFrom(ResourceReleaser &other);
 };
 
 AGZ_D3D12_FG_END
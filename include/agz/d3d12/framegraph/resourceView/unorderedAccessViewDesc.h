@@ -6,6 +6,26 @@
 
 AGZ_D3D12_FG_BEGIN
 
+// how uav accesses of a pass may overlap with the preceding uav pass
+// of the same subresources, which decides whether a uav barrier is needed
+enum class UAVOverlap
+{
+    // wait for all preceding uav accesses
+    Serialize,
+
+    // the pass touches no data accessed by the preceding uav pass
+    NoOverlap,
+
+    // consecutive append-only passes only append to the rsc
+    // (e.g. through atomic counters) and are not serialized
+    AppendOnly
+};
+
+// the pass writes all data covered by the uav before reading any of it.
+// without it, uav content is assumed to be kept across frames, so the rsc
+// is neither aliased nor discarded and its previous writers are not culled
+struct UAVOverwrite { };
+
 struct _internalUAV
 {
     explicit _internalUAV(ResourceIndex rsc) noexcept;
@@ -13,11 +33,17 @@ struct _internalUAV
     ResourceIndex rsc;
 
     D3D12_UNORDERED_ACCESS_VIEW_DESC desc;
+
+    UAVOverlap overlap;
+
+    bool overwrite;
 };
 
 /**
  * - DXGI_FORMAT. default is UNKNOWN (inferred from rsc)
  * - MipmapSlice. mipmap slice of rsc. default is 0
+ * - UAVOverlap. default is Serialize
+ * - UAVOverwrite. default is unset
  */
 struct Tex2DUAV : _internalUAV
 {
@@ -29,6 +55,8 @@ struct Tex2DUAV : _internalUAV
  * - DXGI_FORMAT. default is UNKNOWN (inferred from rsc)
  * - MipmapSlice. mipmap slice of rsc. default is 0
  * - ArraySlices. array elems of rsc. default is [0]
+ * - UAVOverlap. default is Serialize
+ * - UAVOverwrite. default is unset
  */
 struct Tex2DArrUAV : _internalUAV
 {
@@ -36,10 +64,16 @@ struct Tex2DArrUAV : _internalUAV
     explicit Tex2DArrUAV(ResourceIndex rsc, const Args &...args) noexcept;
 };
 
+/**
+ * - UAVOverlap. default is Serialize
+ * - UAVOverwrite. default is unset
+ */
 struct BufUAV : _internalUAV
 {
     template<typename...Args>
-    BufUAV(ResourceIndex rsc, UINT elemSize, UINT elemCnt) noexcept;
+    BufUAV(
+        ResourceIndex rsc, UINT elemSize, UINT elemCnt,
+        const Args &...args) noexcept;
 };
 
 AGZ_D3D12_FG_END
@@ -1,59 +1,177 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+
 #include <agz/d3d12/framegraph/cmdListPool.h>
 #include <agz/d3d12/framegraph/graphData.h>
 
 AGZ_D3D12_FG_BEGIN
 
+struct FrameGraphTaskBatchingOptions
+{
+    // a task is a run of contiguous passes recorded into one cmd list.
+    // tasks are sized so that each thread gets about tasksPerThread of them.
+    // larger values balance threads better, smaller ones give fewer cmd lists
+    int tasksPerThread = 2;
+
+    // max num of passes in a task. 0 means unlimited
+    size_t maxPassesPerTask = 0;
+
+    // estimated recording cost (in microseconds) of a pass
+    // which has not been measured
+    float defaultPassCost = 50;
+
+    // update cost estimations with recording time measured in previous frames
+    bool measurePassCost = true;
+
+    // weight of the newly measured cost
+    float measuredCostWeight = 0.25f;
+
+    // request and submit tasks without locking. when false, the same
+    // task ring is used, but requestTask and submitTask are serialized
+    // on a mutex. cmd lists are taken from CommandListPool under its own
+    // mutex in both cases
+    bool lockFreeSubmission = true;
+
+    // skip binding pipeline states, root signatures, render targets,
+    // viewports and scissors already bound by previous passes in the
+    // same cmd list. only valid when pass funcs leave these states
+    // untouched, or call FrameGraphPassContext::invalidateBoundStates
+    // after changing them
+    bool filterRedundantStates = false;
+};
+
+// queue -> cmd queue. nullptr means the queue is unavailable
+using FrameGraphCmdQueues =
+    std::array<ID3D12CommandQueue *, FRAME_GRAPH_QUEUE_COUNT>;
+
 class FrameGraphTaskScheduler : public misc::uncopyable_t
 {
 public:
 
     FrameGraphTaskScheduler(
-        const std::vector<FrameGraphPassNode> &passNodes,
-        CommandListPool                       &cmdListPool,
-        ComPtr<ID3D12CommandQueue>             cmdQueue);
+        ID3D12Device *device, CommandListPool &cmdListPool);
+
+    void setBatchingOptions(const FrameGraphTaskBatchingOptions &options);
+
+    const FrameGraphTaskBatchingOptions &getBatchingOptions() const noexcept;
 
     struct TaskRange
     {
         const FrameGraphPassNode *begNode = nullptr;
         const FrameGraphPassNode *endNode = nullptr;
+
+        size_t taskIdx = 0;
+
+        FrameGraphQueue queue = FrameGraphQueue::Graphics;
+
+        FrameGraphPassChunk chunk;
     };
 
-    void restart();
+    // prepare for executing passes of graph and split them into tasks.
+    // memory of previous executions is reused.
+    // must not be called concurrently with other methods
+    void restart(
+        const FrameGraphData      &graph,
+        const FrameGraphCmdQueues &cmdQueues,
+        int                        threadCount);
 
+    // lock-free. returns empty range when all tasks are dispatched
     TaskRange requestTask();
 
+    // lock-free. recorded cmd lists are submitted in task order
     void submitTask(
         TaskRange                         taskRange,
         ComPtr<ID3D12GraphicsCommandList> cmdList);
 
+    // report measured recording time of a pass in this frame.
+    // can be called without synchronization as each pass is
+    // recorded by one thread
+    void reportPassCost(size_t passIdx, float microseconds) noexcept;
+
     bool isAllFinished() const noexcept;
 
+    // make the graphics queue wait for other queues used in this frame.
+    // called after all tasks are submitted
+    void joinQueues();
+
 private:
 
-    const std::vector<FrameGraphPassNode> &passNodes_;
+    void splitTasks(int threadCount);
+
+    // flush submittedCmdLists_ to submittedQueue_
+    void flushSubmittedCmdLists();
+
+    const std::vector<FrameGraphPassNode> *passNodes_;
+    const std::vector<FrameGraphPassSync> *passSyncs_;
     CommandListPool                       &cmdListPool_;
-    ComPtr<ID3D12CommandQueue>             cmdQueue_;
+    FrameGraphCmdQueues                    cmdQueues_;
 
-    enum class TaskState
+    // passes [beg, end) of a task are on the same queue.
+    // a task starts with a waiting pass and ends with a signaling pass.
+    // each chunk of a chunked pass is a task of its own. waits are issued
+    // before the first chunk and signals after the last one. all chunks
+    // of a pass are submitted in one ExecuteCommandLists
+
+    struct Task
     {
-        NotFinished,
-        Pending,
-        Submitted
+        size_t beg = 0;
+        size_t end = 0;
+
+        FrameGraphQueue queue = FrameGraphQueue::Graphics;
+
+        FrameGraphPassChunk chunk;
     };
 
-    struct Task
+    std::vector<Task> tasks_;
+
+    std::atomic<size_t> nextTask_;
+
+    // completion ring. the i-th task publishes its cmd list into slot i.
+    // the capacity only grows in restart
+
+    struct CompletionSlot
     {
-        TaskState taskState = TaskState::NotFinished;
-        size_t nodeCount = 0;
         ComPtr<ID3D12GraphicsCommandList> cmdList;
+        std::atomic<bool>                 completed = false;
     };
 
-    std::vector<Task> tasks_;
+    std::unique_ptr<CompletionSlot[]> completionRing_;
+    size_t completionRingCapacity_;
+
+    // the thread owning submittingFlag_ submits completed tasks
+    // starting from nextSubmittedTask_
+
+    std::atomic_flag    submittingFlag_;
+    std::atomic<size_t> nextSubmittedTask_;
+
+    // cmd lists submitted in one ExecuteCommandLists
+    std::vector<ID3D12CommandList *> submittedCmdLists_;
+    FrameGraphQueue                  submittedQueue_;
+
+    // cross-queue synchronization. accessed by the submitting thread
+
+    ComPtr<ID3D12Fence> fences_[FRAME_GRAPH_QUEUE_COUNT];
+    UINT64              fenceValues_[FRAME_GRAPH_QUEUE_COUNT];
+
+    bool isQueueUsed_[FRAME_GRAPH_QUEUE_COUNT];
+
+    // fence value signaled after each pass
+    std::vector<UINT64> passSignalValues_;
+
+    // graphics fence value signaled at the end of the previous frame
+    UINT64 prevFrameFenceValue_;
+
+    // batching
+
+    FrameGraphTaskBatchingOptions batchingOptions_;
+
+    // pass cost estimations are kept between frames of the same graph
+    const std::vector<FrameGraphPassNode> *estimatedPassNodes_;
 
-    size_t dispatchedNodeCount_;
-    size_t finishedNodeCount_;
+    std::vector<float> passCosts_;
+    std::vector<float> measuredPassCosts_;
 };
 
 AGZ_D3D12_FG_END
@@ -1,3 +1,4 @@
+#include <fstream>
 #include <iostream>
 
 #include "./mesh.h"
@@ -294,19 +295,28 @@ void run()
         window.getCommandQueue(),
         2, window.getImageCount());
 
+    // gbuffers are relative to the backbuffer size. resizing the window
+    // recreates them without recompiling the graph
+
+    auto resizeFrameGraph = [&]
+    {
+        graph.resize(
+            static_cast<UINT>(window.getImageWidth()),
+            static_cast<UINT>(window.getImageHeight()));
+    };
+
+    resizeFrameGraph();
+
     fg::ResourceIndex dsIdx, rtIdx, gPosIdx, gNorIdx, gColorIdx;
 
     auto initFrameGraph = [&]
     {
-        const UINT W = static_cast<UINT>(window.getImageWidth());
-        const UINT H = static_cast<UINT>(window.getImageHeight());
-
         using namespace fg;
 
         graph.newGraph();
 
         dsIdx = graph.addInternalResource(
-            Tex2DDesc{ DXGI_FORMAT_D24_UNORM_S8_UINT, W, H });
+            Tex2DDesc{ DXGI_FORMAT_D24_UNORM_S8_UINT, BACKBUFFER_SIZE });
 
         rtIdx = graph.addExternalResource(
             window.getCurrentImage(),
@@ -314,13 +324,13 @@ void run()
             D3D12_RESOURCE_STATE_PRESENT);
 
         gPosIdx = graph.addInternalResource(
-            Tex2DDesc{ DXGI_FORMAT_R32G32B32A32_FLOAT, W, H });
+            Tex2DDesc{ DXGI_FORMAT_R32G32B32A32_FLOAT, BACKBUFFER_SIZE });
 
         gNorIdx = graph.addInternalResource(
-            Tex2DDesc{ DXGI_FORMAT_R32G32B32A32_FLOAT, W, H });
+            Tex2DDesc{ DXGI_FORMAT_R32G32B32A32_FLOAT, BACKBUFFER_SIZE });
 
         gColorIdx = graph.addInternalResource(
-            Tex2DDesc{ DXGI_FORMAT_R8G8B8A8_UNORM, W, H });
+            Tex2DDesc{ DXGI_FORMAT_R8G8B8A8_UNORM, BACKBUFFER_SIZE });
 
         graph.addGraphicsPass(
             [&](ID3D12GraphicsCommandList *cmdList,
@@ -372,9 +382,9 @@ void run()
     initFrameGraph();
 
     window.attach(std::make_shared<WindowPreResizeHandler>(
-        [&] { graph.reset(); }));
+        [&] { graph.clearExternalResources(); }));
     window.attach(std::make_shared<WindowPostResizeHandler>(
-        [&] { initFrameGraph(); }));
+        [&] { resizeFrameGraph(); }));
 
     while(!window.getCloseFlag())
     {
@@ -388,6 +398,17 @@ void run()
 
         if(keyboard->isDown(KEY_ESCAPE))
             window.setCloseFlag(true);
+
+        // press R to dump the compiled graph for inspection
+
+        if(keyboard->isDown(KEY_R))
+        {
+            const auto report = graph.getReport();
+            std::ofstream("08_framegraph_report.json") << fg::toJSON(report);
+            std::ofstream("08_framegraph_report.dot")  << fg::toGraphvizDOT(report);
+            std::cout << "graph report written to 08_framegraph_report.json/.dot"
+                      << std::endl;
+        }
         
         // camera
         
@@ -412,6 +433,7 @@ void run()
         // framegraph
 
         graph.setExternalRsc(rtIdx, window.getCurrentImage());
+
         graph.execute();
 
         // present
@@ -1,3 +1,4 @@
+#include <fstream>
 #include <iostream>
 
 #include <agz/d3d12/imgui/imgui.h>
@@ -97,8 +98,41 @@ void run()
         window.getCommandQueue(),
         2, window.getImageCount());
 
+    // the graph is rebuilt every frame. reuse compiled graphs of
+    // previously seen configurations
+    graph.setGraphCacheCapacity(4);
+
+    // particle simulation runs on the async compute queue,
+    // overlapping with particle rendering
+
+    ComPtr<ID3D12CommandQueue> computeQueue;
+
+    D3D12_COMMAND_QUEUE_DESC computeQueueDesc = {};
+    computeQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+    AGZ_D3D12_CHECK_HR(
+        device->CreateCommandQueue(
+            &computeQueueDesc, IID_PPV_ARGS(computeQueue.GetAddressOf())));
+
+    graph.setAsyncComputeQueue(computeQueue.Get());
+
+    fg::FrameGraphProfilingOptions profilingOptions;
+    profilingOptions.enabled = true;
+    graph.setProfilingOptions(profilingOptions);
+
+    // the depth buffer is relative to the backbuffer size, so kept graphs
+    // are reused after resizing
+    graph.resize(
+        static_cast<UINT>(window.getImageWidth()),
+        static_cast<UINT>(window.getImageHeight()));
+
     window.attach(std::make_shared<WindowPreResizeHandler>(
         [&] { graph.reset(); }));
+    window.attach(std::make_shared<WindowPostResizeHandler>([&]
+    {
+        graph.resize(
+            static_cast<UINT>(window.getImageWidth()),
+            static_cast<UINT>(window.getImageHeight()));
+    }));
 
     float camRotRadX = 0;
     float camRotRadY = 0;
@@ -211,6 +245,26 @@ void run()
                 {
                     particleSys.setConfig(particleConfig);
                 }
+
+                if(ImGui::CollapsingHeader("Pass Profiles"))
+                {
+                    ImGui::Text("cpu/gpu time (us): min/avg/p99");
+
+                    for(auto &p : graph.getPassProfiles())
+                    {
+                        ImGui::Text(
+                            "%-16s %6.1f/%6.1f/%6.1f  %6.1f/%6.1f/%6.1f",
+                            p.name.c_str(),
+                            p.cpuMin, p.cpuAvg, p.cpuP99,
+                            p.gpuMin, p.gpuAvg, p.gpuP99);
+                    }
+
+                    if(ImGui::Button("Export Chrome Trace"))
+                    {
+                        std::ofstream fout("09_particles_trace.json");
+                        fout << graph.exportChromeTrace();
+                    }
+                }
             }
             ImGui::End();
         }
@@ -226,10 +280,7 @@ void run()
             D3D12_RESOURCE_STATE_PRESENT,
             D3D12_RESOURCE_STATE_PRESENT);
 
-        particleSys.initPasses(
-            window.getImageWidth(),
-            window.getImageHeight(),
-            graph, renderTargetIdx);
+        particleSys.initPasses(graph, renderTargetIdx);
 
         graph.addGraphicsPass(
             [&](ID3D12GraphicsCommandList *cmdList,
@@ -237,7 +288,8 @@ void run()
         {
             imgui.render(cmdList);
         },
-            fg::RenderTargetBinding{ fg::Tex2DRTV{ renderTargetIdx } });
+            fg::RenderTargetBinding{ fg::Tex2DRTV{ renderTargetIdx } },
+            fg::PassName{ "imgui" });
 
         graph.compile();
         graph.startFrame(window.getCurrentImageIndex());
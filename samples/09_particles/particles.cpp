@@ -177,7 +177,7 @@ ParticleSystem::ParticleSystem(
     AGZ_D3D12_CHECK_HR(
         device_->CreateCommittedResource(
             &heapProps, D3D12_HEAP_FLAG_NONE, &bufDesc.desc,
-            D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr,
+            D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, nullptr,
             IID_PPV_ARGS(dataB_.GetAddressOf())));
 
     // initialize particle data
@@ -333,8 +333,6 @@ void ParticleSystem::update(
 }
 
 void ParticleSystem::initPasses(
-    int               width,
-    int               height,
     fg::FrameGraph   &graph,
     fg::ResourceIndex renderTarget)
 {
@@ -342,15 +340,19 @@ void ParticleSystem::initPasses(
 
     framegraph_ = &graph;
 
+    // both data buffers are kept in NON_PIXEL_SHADER_RESOURCE between frames.
+    // so rendering reads prevData without transitions and can overlap with
+    // the async simulation
+
     prevData_ = graph.addExternalResource(
         dataA_,
         D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
-        D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
     nextData_ = graph.addExternalResource(
         dataB_,
-        D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
     attractorsRsc_ = graph.addExternalResource(
         attractors_,
@@ -358,10 +360,7 @@ void ParticleSystem::initPasses(
         D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 
     auto depthStencilIdx = graph.addInternalResource(
-        Tex2DDesc{
-            DXGI_FORMAT_D24_UNORM_S8_UINT,
-            static_cast<UINT>(width),
-            static_cast<UINT>(height) });
+        Tex2DDesc{ DXGI_FORMAT_D24_UNORM_S8_UINT, BACKBUFFER_SIZE });
 
     graph.addComputePass(
         [&](ID3D12GraphicsCommandList *cmdList,
@@ -376,11 +375,13 @@ void ParticleSystem::initPasses(
 
         cmdList->Dispatch(particleCount_, 1, 1);
     },
-        BufSRV{ prevData_, sizeof(ParticleData), particleCount_ },
+        BufSRV{ prevData_, sizeof(ParticleData), particleCount_, NonPixelSRV },
         BufUAV{ nextData_, sizeof(ParticleData), particleCount_ },
-        BufSRV{ attractorsRsc_, sizeof(AttractorMesh::AttractorData), attractorCount_ },
+        BufSRV{ attractorsRsc_, sizeof(AttractorMesh::AttractorData), attractorCount_, NonPixelSRV },
         simPipeline_,
-        simRootSignature_);
+        simRootSignature_,
+        ASYNC_COMPUTE,
+        PassName{ "simulate" });
 
     graph.addGraphicsPass(
         [&](ID3D12GraphicsCommandList *cmdList,
@@ -400,9 +401,10 @@ void ParticleSystem::initPasses(
 
         cmdList->DrawInstanced(particleCount_, 1, 0, 0);
     },
-        BufSRV{ prevData_, sizeof(ParticleData), particleCount_ },
+        BufSRV{ prevData_, sizeof(ParticleData), particleCount_, NonPixelSRV },
         RenderTargetBinding{ Tex2DRTV{ renderTarget }, ClearColor{} },
         DepthStencilBinding{ Tex2DDSV{ depthStencilIdx }, ClearDepthStencil{} },
         rdrPipeline_,
-        rdrRootSignature_);
+        rdrRootSignature_,
+        PassName{ "render" });
 }
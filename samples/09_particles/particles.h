@@ -82,8 +82,6 @@ public:
 
     // register passes in framegraph
     void initPasses(
-        int               width,
-        int               height,
         fg::FrameGraph   &graph,
         fg::ResourceIndex renderTarget);
 
@@ -0,0 +1,200 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+#include <agz/d3d12/lab.h>
+
+using namespace agz::d3d12;
+
+// count heap allocations made inside FrameGraph::execute
+
+std::atomic<bool>   countAllocations = false;
+std::atomic<size_t> allocationCount  = 0;
+
+void *operator new(size_t size)
+{
+    if(countAllocations.load(std::memory_order_relaxed))
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    if(void *ret = std::malloc(size ? size : 1))
+        return ret;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+// compare FrameGraph::execute throughput of the lock-free task submission
+// against the same scheduler with requestTask/submitTask serialized on a
+// mutex. only the cost of the scheduler lock is measured: both share the
+// task ring, and take cmd lists from CommandListPool under its mutex.
+// heap allocations made inside FrameGraph::execute are counted as well
+
+constexpr int PASS_COUNT  = 512;
+constexpr int FRAME_COUNT = 200;
+constexpr int WARMUP_FRAME_COUNT = 20;
+
+// simulated cpu cost of recording a pass
+void spin(int microseconds)
+{
+    const auto end = std::chrono::steady_clock::now() +
+                     std::chrono::microseconds(microseconds);
+    while(std::chrono::steady_clock::now() < end)
+        ;
+}
+
+struct BenchmarkResult
+{
+    // average time (in microseconds) of FrameGraph::execute
+    double time = 0;
+
+    // average num of heap allocations made inside FrameGraph::execute
+    double allocations = 0;
+};
+
+BenchmarkResult benchmark(
+    Window &window, int threadCount, bool lockFree, int passCost)
+{
+    auto device   = window.getDevice();
+    auto cmdQueue = window.getCommandQueue();
+
+    DescriptorHeap gpuHeap;
+    gpuHeap.initialize(
+        device, 1, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true);
+
+    DescriptorHeap rtvHeap;
+    rtvHeap.initialize(
+        device, 1, D3D12_DESCRIPTOR_HEAP_TYPE_RTV, false);
+
+    DescriptorHeap dsvHeap;
+    dsvHeap.initialize(
+        device, 1, D3D12_DESCRIPTOR_HEAP_TYPE_DSV, false);
+
+    fg::FrameGraph graph(
+        device,
+        window.getAdaptor(),
+        rtvHeap.allocSubHeap(1),
+        dsvHeap.allocSubHeap(1),
+        gpuHeap.allocSubHeap(1),
+        cmdQueue,
+        threadCount, 1);
+
+    // one pass per task so that every pass goes through the scheduler
+
+    fg::FrameGraphTaskBatchingOptions batchingOptions;
+    batchingOptions.maxPassesPerTask   = 1;
+    batchingOptions.measurePassCost    = false;
+    batchingOptions.lockFreeSubmission = lockFree;
+    graph.setTaskBatchingOptions(batchingOptions);
+
+    graph.newGraph();
+    for(int i = 0; i < PASS_COUNT; ++i)
+    {
+        graph.addComputePass(
+            [passCost](ID3D12GraphicsCommandList *, fg::FrameGraphPassContext &)
+        {
+            if(passCost > 0)
+                spin(passCost);
+        },
+            fg::SIDE_EFFECT);
+    }
+    graph.compile();
+
+    CommandQueueWaiter waiter(device);
+
+    double totalTime = 0;
+    size_t totalAllocations = 0;
+
+    for(int i = 0; i < WARMUP_FRAME_COUNT + FRAME_COUNT; ++i)
+    {
+        graph.startFrame(0);
+
+        const bool measured = i >= WARMUP_FRAME_COUNT;
+
+        allocationCount  = 0;
+        countAllocations = measured;
+
+        const auto start = std::chrono::steady_clock::now();
+        graph.execute();
+        const auto end = std::chrono::steady_clock::now();
+
+        countAllocations = false;
+
+        graph.endFrame();
+        waiter.waitIdle(cmdQueue);
+
+        if(measured)
+        {
+            totalTime += std::chrono::duration<double, std::micro>(
+                end - start).count();
+            totalAllocations += allocationCount;
+        }
+    }
+
+    return {
+        totalTime / FRAME_COUNT,
+        static_cast<double>(totalAllocations) / FRAME_COUNT
+    };
+}
+
+void run()
+{
+    enableD3D12DebugLayerInDebugMode();
+
+    WindowDesc desc;
+    desc.title     = L"10.scheduler.benchmark";
+    desc.resizable = false;
+
+    Window window(desc);
+
+    for(int passCost : { 0, 10 })
+    {
+        std::cout << PASS_COUNT << " passes, "
+                  << passCost << "us per pass" << std::endl;
+
+        std::cout << std::setw(8)  << "threads"
+                  << std::setw(16) << "serialized (us)"
+                  << std::setw(16) << "lock-free (us)"
+                  << std::setw(10) << "speedup"
+                  << std::setw(14) << "allocs/frame" << std::endl;
+
+        for(int threadCount : { 1, 2, 4, 8, 16, 32 })
+        {
+            const auto serialized = benchmark(
+                window, threadCount, false, passCost);
+            const auto lockFree = benchmark(
+                window, threadCount, true, passCost);
+
+            std::cout << std::setw(8)  << threadCount
+                      << std::setw(16) << std::fixed << std::setprecision(1)
+                                       << serialized.time
+                      << std::setw(16) << lockFree.time
+                      << std::setw(10) << std::setprecision(2)
+                                       << serialized.time / lockFree.time
+                      << std::setw(14) << std::setprecision(1)
+                                       << lockFree.allocations
+                      << std::endl;
+        }
+
+        std::cout << std::endl;
+    }
+
+    window.waitCommandQueueIdle();
+}
+
+int main()
+{
+    try
+    {
+        run();
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
+}
@@ -2,6 +2,25 @@
 
 AGZ_D3D12_FG_BEGIN
 
+namespace
+{
+
+    D3D12_COMMAND_LIST_TYPE getCommandListType(FrameGraphQueue queue) noexcept
+    {
+        switch(queue)
+        {
+        case FrameGraphQueue::Graphics:
+            return D3D12_COMMAND_LIST_TYPE_DIRECT;
+        case FrameGraphQueue::Compute:
+            return D3D12_COMMAND_LIST_TYPE_COMPUTE;
+        case FrameGraphQueue::Copy:
+            return D3D12_COMMAND_LIST_TYPE_COPY;
+        }
+        misc::unreachable();
+    }
+
+} // namespace anonymous
+
 CommandListPool::CommandListPool(
     ComPtr<ID3D12Device> device, int threadCount, int frameCount)
     : device_(std::move(device))
@@ -11,14 +30,18 @@ CommandListPool::CommandListPool(
     threadResources_.resize(threadCount);
     for(auto &t : threadResources_)
     {
-        t.graphicsCmdAllocs_.resize(frameCount);
-
-        for(auto &ca : t.graphicsCmdAllocs_)
+        for(int q = 0; q < FRAME_GRAPH_QUEUE_COUNT; ++q)
         {
-            AGZ_D3D12_CHECK_HR(
-                device_->CreateCommandAllocator(
-                    D3D12_COMMAND_LIST_TYPE_DIRECT,
-                    IID_PPV_ARGS(ca.GetAddressOf())));
+            const auto type =
+                getCommandListType(static_cast<FrameGraphQueue>(q));
+
+            t.cmdAllocs_[q].resize(frameCount);
+            for(auto &ca : t.cmdAllocs_[q])
+            {
+                AGZ_D3D12_CHECK_HR(
+                    device_->CreateCommandAllocator(
+                        type, IID_PPV_ARGS(ca.GetAddressOf())));
+            }
         }
     }
 }
@@ -26,33 +49,39 @@ CommandListPool::CommandListPool(
 void CommandListPool::startFrame(int frameIndex)
 {
     for(auto &t : threadResources_)
-        AGZ_D3D12_CHECK_HR(t.graphicsCmdAllocs_[frameIndex]->Reset());
+    {
+        for(auto &allocs : t.cmdAllocs_)
+            AGZ_D3D12_CHECK_HR(allocs[frameIndex]->Reset());
+    }
 
     frameIndex_ = frameIndex;
 }
 
-ComPtr<ID3D12GraphicsCommandList>
-    CommandListPool::requireGraphicsCommandList(int threadIndex)
+ComPtr<ID3D12GraphicsCommandList> CommandListPool::requireCommandList(
+    int threadIndex, FrameGraphQueue queue)
 {
+    const int q = static_cast<int>(queue);
+
     ComPtr<ID3D12GraphicsCommandList> ret;
 
     {
-        std::lock_guard lk(unusedGraphicsCmdListsMutex_);
-        if(!unusedGraphicsCmdLists_.empty())
+        std::lock_guard lk(unusedCmdListsMutex_);
+        auto &unusedCmdLists = unusedCmdLists_[q];
+        if(!unusedCmdLists.empty())
         {
-            ret = unusedGraphicsCmdLists_.front();
-            unusedGraphicsCmdLists_.erase(unusedGraphicsCmdLists_.begin());
+            ret = unusedCmdLists.front();
+            unusedCmdLists.erase(unusedCmdLists.begin());
         }
     }
 
     auto alloc = threadResources_[threadIndex]
-        .graphicsCmdAllocs_[frameIndex_].Get();
+        .cmdAllocs_[q][frameIndex_].Get();
 
     if(!ret)
     {
         AGZ_D3D12_CHECK_HR(
             device_->CreateCommandList(
-                0, D3D12_COMMAND_LIST_TYPE_DIRECT, alloc, nullptr,
+                0, getCommandListType(queue), alloc, nullptr,
                 IID_PPV_ARGS(ret.GetAddressOf())));
     }
     else
@@ -61,11 +90,11 @@ ComPtr<ID3D12GraphicsCommandList>
     return ret;
 }
 
-void CommandListPool::addUnusedGraphicsCmdLists(
-    ComPtr<ID3D12GraphicsCommandList> cmdList)
+void CommandListPool::addUnusedCommandList(
+    FrameGraphQueue queue, ComPtr<ID3D12GraphicsCommandList> cmdList)
 {
-    std::lock_guard lk(unusedGraphicsCmdListsMutex_);
-    unusedGraphicsCmdLists_.push_back(cmdList);
+    std::lock_guard lk(unusedCmdListsMutex_);
+    unusedCmdLists_[static_cast<int>(queue)].push_back(std::move(cmdList));
 }
 
 AGZ_D3D12_FG_END
@@ -1,7 +1,175 @@
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
 #include <agz/d3d12/framegraph/compiler.h>
+#include <agz/d3d12/framegraph/passContext.h>
 
 AGZ_D3D12_FG_BEGIN
 
+namespace
+{
+
+    template<typename T>
+    void appendKey(std::string &key, const T &value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        key.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    void appendKey(std::string &key, const D3D12_RESOURCE_DESC &desc)
+    {
+        // field by field to skip paddings
+
+        appendKey(key, desc.Dimension);
+        appendKey(key, desc.Alignment);
+        appendKey(key, desc.Width);
+        appendKey(key, desc.Height);
+        appendKey(key, desc.DepthOrArraySize);
+        appendKey(key, desc.MipLevels);
+        appendKey(key, desc.Format);
+        appendKey(key, desc.SampleDesc.Count);
+        appendKey(key, desc.SampleDesc.Quality);
+        appendKey(key, desc.Layout);
+        appendKey(key, desc.Flags);
+    }
+
+    // planes of depth stencil formats are tracked together, as dsvs
+    // always cover both of them
+    UINT getPlaneCount(DXGI_FORMAT format) noexcept
+    {
+        switch(format)
+        {
+        case DXGI_FORMAT_R24G8_TYPELESS:
+        case DXGI_FORMAT_D24_UNORM_S8_UINT:
+        case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+        case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+        case DXGI_FORMAT_R32G8X24_TYPELESS:
+        case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+        case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+        case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+            return 2;
+        default:
+            return 1;
+        }
+    }
+
+    UINT getFullMipmapChainLength(const D3D12_RESOURCE_DESC &desc) noexcept
+    {
+        UINT64 size = (std::max)(desc.Width, static_cast<UINT64>(desc.Height));
+        if(desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D)
+            size = (std::max)(size, static_cast<UINT64>(desc.DepthOrArraySize));
+
+        UINT ret = 1;
+        while(size > 1)
+        {
+            size >>= 1;
+            ++ret;
+        }
+        return ret;
+    }
+
+    // mipmaps [firstMip, firstMip + mipCount) of array slices
+    // [firstSlice, firstSlice + sliceCount). -1 means all the rest
+    struct SubresourceRange
+    {
+        UINT firstMip   = 0;
+        UINT mipCount   = UINT(-1);
+        UINT firstSlice = 0;
+        UINT sliceCount = UINT(-1);
+    };
+
+    SubresourceRange getViewSubresourceRange(
+        const FrameGraphCompiler::CompilerPassNode::RscInPass::ViewDesc &view)
+    {
+        return match_variant(view,
+            [](const _internalSRV &srv) -> SubresourceRange
+        {
+            auto &d = srv.desc;
+            switch(d.ViewDimension)
+            {
+            case D3D12_SRV_DIMENSION_TEXTURE2D:
+                return { d.Texture2D.MostDetailedMip, d.Texture2D.MipLevels, 0, 1 };
+            case D3D12_SRV_DIMENSION_TEXTURE2DARRAY:
+                return {
+                    d.Texture2DArray.MostDetailedMip, d.Texture2DArray.MipLevels,
+                    d.Texture2DArray.FirstArraySlice, d.Texture2DArray.ArraySize };
+            case D3D12_SRV_DIMENSION_TEXTURE2DMS:
+                return { 0, 1, 0, 1 };
+            case D3D12_SRV_DIMENSION_TEXTURE2DMSARRAY:
+                return {
+                    0, 1, d.Texture2DMSArray.FirstArraySlice,
+                    d.Texture2DMSArray.ArraySize };
+            default:
+                return {};
+            }
+        },
+            [](const _internalUAV &uav) -> SubresourceRange
+        {
+            auto &d = uav.desc;
+            switch(d.ViewDimension)
+            {
+            case D3D12_UAV_DIMENSION_TEXTURE2D:
+                return { d.Texture2D.MipSlice, 1, 0, 1 };
+            case D3D12_UAV_DIMENSION_TEXTURE2DARRAY:
+                return {
+                    d.Texture2DArray.MipSlice, 1,
+                    d.Texture2DArray.FirstArraySlice, d.Texture2DArray.ArraySize };
+            default:
+                return {};
+            }
+        },
+            [](const _internalRTV &rtv) -> SubresourceRange
+        {
+            auto &d = rtv.desc;
+            switch(d.ViewDimension)
+            {
+            case D3D12_RTV_DIMENSION_TEXTURE2D:
+                return { d.Texture2D.MipSlice, 1, 0, 1 };
+            case D3D12_RTV_DIMENSION_TEXTURE2DARRAY:
+                return {
+                    d.Texture2DArray.MipSlice, 1,
+                    d.Texture2DArray.FirstArraySlice, d.Texture2DArray.ArraySize };
+            case D3D12_RTV_DIMENSION_TEXTURE2DMS:
+                return { 0, 1, 0, 1 };
+            case D3D12_RTV_DIMENSION_TEXTURE2DMSARRAY:
+                return {
+                    0, 1, d.Texture2DMSArray.FirstArraySlice,
+                    d.Texture2DMSArray.ArraySize };
+            default:
+                return {};
+            }
+        },
+            [](const _internalDSV &dsv) -> SubresourceRange
+        {
+            auto &d = dsv.desc;
+            switch(d.ViewDimension)
+            {
+            case D3D12_DSV_DIMENSION_TEXTURE2D:
+                return { d.Texture2D.MipSlice, 1, 0, 1 };
+            case D3D12_DSV_DIMENSION_TEXTURE2DARRAY:
+                return {
+                    d.Texture2DArray.MipSlice, 1,
+                    d.Texture2DArray.FirstArraySlice, d.Texture2DArray.ArraySize };
+            case D3D12_DSV_DIMENSION_TEXTURE2DMS:
+                return { 0, 1, 0, 1 };
+            case D3D12_DSV_DIMENSION_TEXTURE2DMSARRAY:
+                return {
+                    0, 1, d.Texture2DMSArray.FirstArraySlice,
+                    d.Texture2DMSArray.ArraySize };
+            default:
+                return {};
+            }
+        },
+            [](const std::monostate &) -> SubresourceRange
+        {
+            // copies may access any subresource
+            return {};
+        });
+    }
+
+} // namespace anonymous
+
 std::optional<D3D12_CLEAR_VALUE>
     FrameGraphCompiler::CompilerInternalResourceNode
         ::getClearValue() const noexcept
@@ -97,21 +265,149 @@ ResourceIndex FrameGraphCompiler::addExternalResource(
     return { idx };
 }
 
+HistoryResourceIndex FrameGraphCompiler::addHistoryResource(
+    const RscDesc &rscDesc, int32_t historyLength)
+{
+    assert(historyLength > 0);
+
+    CompilerHistoryRing ring;
+    ring.desc          = rscDesc;
+    ring.first         = { static_cast<int32_t>(rscs_.size()) };
+    ring.historyLength = historyLength;
+
+    CompilerExternalResourceNode newNode;
+    newNode.historyRing = static_cast<int32_t>(historyRings_.size());
+
+    for(int32_t k = 0; k < historyLength; ++k)
+        rscs_.emplace_back(newNode);
+
+    historyRings_.push_back(ring);
+    return { ring.first, historyLength };
+}
+
+PassIndex FrameGraphCompiler::addResolvePass(
+    ResourceIndex src,
+    ResourceIndex dst,
+    PassName      name,
+    DXGI_FORMAT   format)
+{
+    if(src.idx == dst.idx)
+        throw D3D12LabException("resolving a rsc into itself");
+
+    const auto idx = static_cast<int32_t>(passes_.size());
+    passes_.emplace_back();
+    auto &newPass = passes_.back();
+
+    newPass.index      = { idx };
+    newPass.isGraphics = false;
+    newPass.isResolve  = true;
+    newPass.name       = std::move(name.name);
+
+    CompilerPassNode::RscInPass srcUsage;
+    srcUsage.idx     = src;
+    srcUsage.inState = D3D12_RESOURCE_STATE_RESOLVE_SOURCE;
+    newPass.rscs.push_back(srcUsage);
+
+    CompilerPassNode::RscInPass dstUsage;
+    dstUsage.idx          = dst;
+    dstUsage.inState      = D3D12_RESOURCE_STATE_RESOLVE_DEST;
+    dstUsage.firstMipOnly = true;
+    newPass.rscs.push_back(dstUsage);
+
+    newPass.passFunc = [src, dst, format](
+        ID3D12GraphicsCommandList *cmdList, FrameGraphPassContext &ctx)
+    {
+        auto srcRsc = ctx.getResource(src).rsc;
+        auto dstRsc = ctx.getResource(dst).rsc;
+
+        const auto srcDesc = srcRsc->GetDesc();
+        const auto dstDesc = dstRsc->GetDesc();
+
+        DXGI_FORMAT resolveFormat = format;
+        if(resolveFormat == DXGI_FORMAT_UNKNOWN)
+        {
+            resolveFormat = isTypeless(dstDesc.Format) ?
+                            srcDesc.Format : dstDesc.Format;
+        }
+
+        for(UINT a = 0; a < srcDesc.DepthOrArraySize; ++a)
+        {
+            cmdList->ResolveSubresource(
+                dstRsc.Get(),
+                D3D12CalcSubresource(
+                    0, a, 0, dstDesc.MipLevels, dstDesc.DepthOrArraySize),
+                srcRsc.Get(), a, resolveFormat);
+        }
+    };
+
+    return { idx };
+}
+
+void FrameGraphCompiler::setBackbufferSize(UINT width, UINT height)
+{
+    backbufferWidth_  = width;
+    backbufferHeight_ = height;
+}
+
 FrameGraphData FrameGraphCompiler::compile(
-    ResourceAllocator &rscAlloc,
-    ResourceReleaser  &rscReleaser)
+    ResourceAllocator              &rscAlloc,
+    ResourceReleaser               &rscReleaser,
+    ResourceReleaser               &relativeRscReleaser,
+    const FrameGraphCompileOptions &options)
 {
     FrameGraphData ret;
     ret.rscNodes.reserve(rscs_.size());
     ret.passNodes.reserve(passes_.size());
 
+    // derive sizes of backbuffer-relative rscs
+
+    ret.backbufferWidth  = backbufferWidth_;
+    ret.backbufferHeight = backbufferHeight_;
+
+    for(auto &rsc : rscs_)
+    {
+        auto in = rsc.as_if<CompilerInternalResourceNode>();
+        if(in && in->desc.relativeSize)
+        {
+            resolveBackbufferRelativeSize(
+                in->desc.desc, *in->desc.relativeSize,
+                backbufferWidth_, backbufferHeight_);
+        }
+    }
+
+    // history rings are compiled as external rscs
+
+    createHistoryRings(ret, rscAlloc, rscReleaser, relativeRscReleaser);
+
+    // cull unused passes. states are tracked per group of subresources,
+    // which are regrouped after culling as culled usages may split them
+
+    createStateTracks();
+    cullPasses(ret.statistics);
+    createStateTracks();
+
+    // reorder passes
+
+    if(options.reorderPasses)
+        reorderPasses(ret.statistics);
+
+    // assign passes to queues
+
+    assignQueues(options, ret.statistics);
+
     // collect usages
 
     const auto usageInfo = collectRscUsages();
 
-    ret.gpuDescCount = usageInfo.gpuDescCount;
-    ret.rtvDescCount = usageInfo.rtvDescCount;
-    ret.dsvDescCount = usageInfo.dsvDescCount;
+    ret.gpuDescCount = usageInfo.frameDescCount.gpu;
+    ret.rtvDescCount = usageInfo.frameDescCount.rtv;
+    ret.dsvDescCount = usageInfo.frameDescCount.dsv;
+
+    ret.graphGPUDescCount = usageInfo.graphDescCount.gpu;
+    ret.graphRTVDescCount = usageInfo.graphDescCount.rtv;
+    ret.graphDSVDescCount = usageInfo.graphDescCount.dsv;
+
+    checkTrackStatesInPasses(usageInfo.trackTempNodes);
 
     // infer rsc flags & clear values
 
@@ -121,40 +417,290 @@ FrameGraphData FrameGraphCompiler::compile(
             inferRscCreationFlagAndClearValue(rscUsage);
     }
 
+    // cross-queue synchronization
+
+    ret.passSyncs = computePassSyncs(usageInfo.trackTempNodes, ret.statistics);
+
+    // place transient rscs in shared heaps
+
+    const auto transientInfo = planTransientMemory(usageInfo, rscAlloc);
+
+    std::vector<D3D12MA::Allocation *> transientHeaps;
+    transientHeaps.reserve(transientInfo.heaps.size());
+
+    for(auto &heap : transientInfo.heaps)
+    {
+        auto memory = rscAlloc.allocMemory(
+            heap.byteSize, heap.alignment, heap.heapFlags);
+        (heap.relative ? relativeRscReleaser : rscReleaser).add(
+            rscAlloc, memory);
+        transientHeaps.push_back(memory);
+
+        if(heap.relative)
+            ret.relativeTransientMemoryAfterAliasing += heap.byteSize;
+    }
+
+    ret.statistics.transientMemoryBeforeAliasing =
+        transientInfo.byteSizeBeforeAliasing;
+    ret.statistics.transientMemoryAfterAliasing =
+        transientInfo.byteSizeAfterAliasing;
+
     // allocate d3d rsc
 
-    for(auto &rsc : rscs_)
+    // index in ret.relativeRscs of each rsc. -1 if not relative
+    std::vector<int> relativeIndices(rscs_.size(), -1);
+
+    for(size_t i = 0; i < rscs_.size(); ++i)
     {
-        ret.rscNodes.push_back(
-            createD3DRscNode(rsc, rscAlloc, rscReleaser));
+        auto &placement = transientInfo.placements[i];
+
+        auto in = rscs_[i].as_if<CompilerInternalResourceNode>();
+        const bool isRelative = in && in->desc.relativeSize;
+        auto &releaser = isRelative ? relativeRscReleaser : rscReleaser;
+
+        if(in && usageInfo.rscTempNodes[i].users.empty())
+        {
+            ret.statistics.culledRscs.push_back(
+                { static_cast<int32_t>(i) });
+            ret.rscNodes.emplace_back(false, nullptr);
+            continue;
+        }
+
+        if(placement.heapIdx >= 0)
+        {
+            ret.rscNodes.push_back(createPlacedD3DRscNode(
+                *in, transientHeaps[placement.heapIdx], placement.offset,
+                rscAlloc, releaser));
+        }
+        else
+        {
+            ret.rscNodes.push_back(
+                createD3DRscNode(rscs_[i], rscAlloc, releaser));
+        }
+
+        if(placement.aliased)
+            ++ret.statistics.aliasedRscCount;
+
+        if(isRelative)
+        {
+            const auto clearValue = in->getClearValue();
+
+            FrameGraphRelativeResource relativeRsc;
+            relativeRsc.rscIdx       = static_cast<int32_t>(i);
+            relativeRsc.size         = *in->desc.relativeSize;
+            relativeRsc.desc         = {
+                in->desc.desc,
+                clearValue.has_value(),
+                clearValue.has_value() ? *clearValue : D3D12_CLEAR_VALUE{}
+            };
+            relativeRsc.initialState = in->initialState;
+
+            if(placement.heapIdx >= 0)
+            {
+                const auto &users = usageInfo.rscTempNodes[i].users;
+                relativeRsc.firstPass = users.front().first.idx;
+                relativeRsc.lastPass  = users.back().first.idx;
+            }
+
+            relativeIndices[i] = static_cast<int>(ret.relativeRscs.size());
+            ret.relativeRscs.push_back(relativeRsc);
+        }
     }
 
+    ret.relativeTransientMemoryBeforeAliasing =
+        transientInfo.relativeByteSizeBeforeAliasing;
+
     // allocate cpu/gpu desc range
 
-    DescriptorIndex rtvDescIdx = 0;
-    DescriptorIndex dsvDescIdx = 0;
-    DescriptorIndex gpuDescIdx = 0;
+    DescriptorIndices frameDescIdx;
+    DescriptorIndices graphDescIdx;
+
+    // reserve flat execution data, so that slices are never invalidated
+
+    // aliasing + in transitions + transitions after discarding + uav +
+    // out transitions + trailing uav for each pass rsc. transitions are
+    // per subresource if any
+
+    auto getBarrierCount = [](size_t subresourceCount)
+    {
+        return 3 + 3 * (std::max)(subresourceCount, size_t(1));
+    };
+
+    size_t maxPassRscCount = 0;
+    size_t maxSubresourceCount = 0;
+    size_t maxBarrierCount = 0;
+
+    for(auto &pass : passes_)
+    {
+        for(auto &rscUsage : pass.rscs)
+        {
+            for(auto &trackUsage : rscUsage.tracks)
+            {
+                const size_t n = tracks_[trackUsage.track].subresources.size();
+                ++maxPassRscCount;
+                maxSubresourceCount += n;
+                maxBarrierCount += getBarrierCount(n);
+            }
+        }
+    }
+
+    ret.passRscs.reserve(maxPassRscCount);
+    ret.passSubresources.reserve(maxSubresourceCount);
+    ret.passRTVHandles.reserve(maxPassRscCount);
+    ret.passBarriers.reserve(maxBarrierCount);
 
     // fill fg pass nodes
 
     for(auto &pass : passes_)
     {
-        std::map<ResourceIndex, FrameGraphPassNode::PassResource> passRscs;
+        std::vector<FrameGraphPassNode::PassResource> passRscs;
+
+        // create final pass resource node.
+        // a usage covering several state tracks has one per track
+
+        const bool persistentGPUDescs = hasPersistentGPUDescs(pass);
+
+        // descriptors used by a bundle must outlive it
+
+        if(pass.isStatic && !persistentGPUDescs)
+        {
+            throw D3D12LabException(
+                getPassName(pass) + " is static but uses srvs/uavs of "
+                "external rscs");
+        }
+
+        if(pass.isStatic && pass.chunkCount > 1)
+        {
+            throw D3D12LabException(
+                getPassName(pass) + " is static but split into chunks");
+        }
+
+        if(pass.isResolve)
+        {
+            const auto srcDesc = ret.rscNodes[pass.rscs[0].idx.idx]
+                .getD3DResource()->GetDesc();
+            const auto dstDesc = ret.rscNodes[pass.rscs[1].idx.idx]
+                .getD3DResource()->GetDesc();
+
+            if(srcDesc.SampleDesc.Count <= 1 || dstDesc.SampleDesc.Count > 1)
+            {
+                throw D3D12LabException(
+                    getPassName(pass) + " resolves a single-sampled rsc "
+                    "or into a multisampled one");
+            }
 
-        // create final pass resource node
+            if(srcDesc.DepthOrArraySize != dstDesc.DepthOrArraySize)
+            {
+                throw D3D12LabException(
+                    getPassName(pass) + " resolves rscs with different "
+                    "array sizes");
+            }
+        }
 
         const CompilerPassNode::RscInPass::ViewDesc *rtdsView = nullptr;
         for(auto &rscUsage : pass.rscs)
         {
-            passRscs[rscUsage.idx] = createFinalPassResource(
-                rscUsage, usageInfo.rscTempNodes, ret.rscNodes,
-                gpuDescIdx, rtvDescIdx, dsvDescIdx, rtdsView);
+            for(size_t ti = 0; ti < rscUsage.tracks.size(); ++ti)
+            {
+                auto passRsc = createFinalPassResource(
+                    rscUsage, ti, usageInfo,
+                    transientInfo.placements, ret.rscNodes,
+                    persistentGPUDescs, frameDescIdx, graphDescIdx, rtdsView);
+
+                const auto &subrscs =
+                    tracks_[rscUsage.tracks[ti].track].subresources;
+                passRsc.subresources = {
+                    ret.passSubresources.data() + ret.passSubresources.size(),
+                    subrscs.size()
+                };
+                ret.passSubresources.insert(
+                    ret.passSubresources.end(), subrscs.begin(), subrscs.end());
+
+                if(passRsc.splitBeginPass >= 0)
+                    ++ret.statistics.splitBarrierCandidateCount;
+
+                passRscs.push_back(passRsc);
+            }
+        }
+
+        // usages of the same rsc keep their declaration order
+
+        std::stable_sort(passRscs.begin(), passRscs.end(),
+            [](const FrameGraphPassNode::PassResource &a,
+               const FrameGraphPassNode::PassResource &b)
+        {
+            return a.rscIdx < b.rscIdx;
+        });
+
+        // a uav barrier covers all subresources of the rsc
+
+        size_t firstOfRsc = 0;
+        for(size_t j = 0; j < passRscs.size(); ++j)
+        {
+            auto &p = passRscs[j];
+
+            if(p.inState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS &&
+               p.beforeState == p.inState && !p.uavBarrier)
+                ++ret.statistics.elidedUAVBarrierCount;
+
+            if(!j || passRscs[j - 1].rscIdx.idx != p.rscIdx.idx)
+            {
+                firstOfRsc = j;
+                continue;
+            }
+
+            auto &first = passRscs[firstOfRsc];
+
+            if(p.uavBarrier)
+            {
+                if(first.uavBarrier)
+                    ++ret.statistics.elidedUAVBarrierCount;
+                first.uavBarrier = true;
+                p.uavBarrier     = false;
+            }
+
+            first.outUAVBarrier |= p.outUAVBarrier;
+            p.outUAVBarrier      = false;
+        }
+
+        for(auto &p : passRscs)
+        {
+            if(p.outUAVBarrier)
+                ++ret.statistics.trailingUAVBarrierCount;
         }
 
         // viewport & scissor
 
-        auto inferredVP = inferDefaultViewportAndScissor(
-            rtdsView, ret.rscNodes);
+        const int32_t rtdsRsc = rtdsView ? match_variant(*rtdsView,
+            [](const _internalRTV &rt) { return rt.rsc.idx; },
+            [](const _internalDSV &ds) { return ds.rsc.idx; },
+            [](const auto &) { return int32_t(-1); }) : -1;
+
+        FrameGraphPassNode::PassViewport inferredVP;
+        if(rtdsRsc >= 0)
+        {
+            const auto rtdsDesc =
+                ret.rscNodes[rtdsRsc].getD3DResource()->GetDesc();
+            inferredVP = inferDefaultViewportAndScissor(rtdsDesc);
+
+            // external & backbuffer-relative rscs may be resized
+            // without recompiling
+
+            if(pass.isGraphics &&
+               (pass.defaultViewport || pass.defaultScissor) &&
+               (rscs_[rtdsRsc].is<CompilerExternalResourceNode>() ||
+                relativeIndices[rtdsRsc] >= 0))
+            {
+                FrameGraphInferredViewport inferredViewport;
+                inferredViewport.passIdx  = ret.passNodes.size();
+                inferredViewport.rscIdx   = rtdsRsc;
+                inferredViewport.viewport = pass.defaultViewport;
+                inferredViewport.scissor  = pass.defaultScissor;
+                inferredViewport.width    = rtdsDesc.Width;
+                inferredViewport.height   = rtdsDesc.Height;
+                ret.inferredViewports.push_back(inferredViewport);
+            }
+        }
 
         FrameGraphPassNode::PassViewport vp;
         if(pass.defaultViewport)
@@ -167,125 +713,2201 @@ FrameGraphData FrameGraphCompiler::compile(
         else
             vp.scissors = pass.scissors;
 
+        // flatten execution data
+
+        FrameGraphPassNode::PassData passData;
+
+        const size_t rscOffset = ret.passRscs.size();
+        size_t rtvCount = 0;
+        size_t barrierCount = 0;
+
+        for(size_t j = 0; j < passRscs.size(); ++j)
+        {
+            auto &p = passRscs[j];
+
+            // aliasing of relative rscs is patched when they are resized
+
+            const bool isFirstOfRsc =
+                !j || passRscs[j - 1].rscIdx.idx != p.rscIdx.idx;
+
+            if(const int r = relativeIndices[p.rscIdx.idx];
+               r >= 0 && isFirstOfRsc)
+            {
+                auto &relativeRsc = ret.relativeRscs[r];
+                if(relativeRsc.firstPass ==
+                   static_cast<int32_t>(ret.passNodes.size()))
+                    relativeRsc.firstPassRsc = ret.passRscs.size();
+            }
+
+            ret.passRscs.push_back(p);
+            if(p.rtdsBinding.is<FrameGraphPassNode::PassResource::RTB>())
+                ++rtvCount;
+
+            barrierCount += getBarrierCount(p.subresources.size);
+        }
+
+        const size_t barrierOffset = ret.passBarriers.size();
+        ret.passBarriers.resize(barrierOffset + barrierCount);
+
+        const size_t rtvOffset = ret.passRTVHandles.size();
+        ret.passRTVHandles.resize(rtvOffset + rtvCount);
+
+        passData.rscs = {
+            ret.passRscs.data() + rscOffset, passRscs.size() };
+        passData.barriers = {
+            ret.passBarriers.data() + barrierOffset, barrierCount };
+        passData.rtvHandles = {
+            ret.passRTVHandles.data() + rtvOffset, rtvCount };
+        passData.renderPass = pass.isGraphics && options.renderPasses;
+        passData.bundle     = pass.isStatic;
+        passData.chunkCount = pass.chunkCount;
+
         if(pass.isGraphics)
         {
             ret.passNodes.emplace_back(
-                std::move(passRscs), vp, pass.passFunc,
+                passData, vp, pass.passFunc,
                 pass.pipelineState, pass.rootSignature);
         }
         else
         {
             ret.passNodes.emplace_back(
-                std::move(passRscs), pass.passFunc,
+                passData, pass.passFunc,
                 pass.pipelineState, pass.rootSignature);
         }
+
+        ret.passDeclIndices.push_back(pass.index);
+        ret.passNames.push_back(getPassName(pass));
     }
 
+    // merge adjacent graphics passes sharing rts/ds
+
+    if(options.mergePasses)
+        mergePasses(ret);
+
     return ret;
 }
 
-void FrameGraphCompiler::inferRscCreationFlagAndClearValue(
-    CompilerPassNode::RscInPass &rscUsage)
+std::string FrameGraphCompiler::getStructureKey(
+    const FrameGraphCompileOptions &options) const
 {
-    if(auto tn = rscs_[rscUsage.idx.idx].as_if
-        <CompilerInternalResourceNode>(); tn)
-    {
-        if(tn->initialState == D3D12_RESOURCE_STATE_COMMON)
-            tn->initialState = rscUsage.inState;
+    std::string key;
 
-        if(rscUsage.inState & D3D12_RESOURCE_STATE_RENDER_TARGET)
-        {
-            tn->desc.desc.Flags |=
-                D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
-        }
+    appendKey(key, options.reorderPasses);
+    appendKey(key, options.asyncCompute);
+    appendKey(key, options.copyQueue);
+    appendKey(key, options.renderPasses);
+    appendKey(key, options.mergePasses);
 
-        if(rscUsage.inState & D3D12_RESOURCE_STATE_DEPTH_WRITE)
+    // rscs
+
+    appendKey(key, rscs_.size());
+    for(auto &rsc : rscs_)
+    {
+        match_variant(rsc,
+            [&](const CompilerInternalResourceNode &in)
         {
-            tn->desc.desc.Flags |=
-                D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
-        }
+            // sizes of backbuffer-relative rscs are not part of the
+            // structure. graphs are resized without recompiling
 
-        if(rscUsage.inState & D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+            appendKey(key, 'I');
+            if(in.desc.relativeSize)
+            {
+                auto desc = in.desc.desc;
+                desc.Width  = 0;
+                desc.Height = 0;
+
+                appendKey(key, desc);
+                appendKey(key, in.desc.relativeSize->widthScale);
+                appendKey(key, in.desc.relativeSize->heightScale);
+            }
+            else
+                appendKey(key, in.desc.desc);
+            appendKey(key, in.initialState);
+            appendKey(key, in.clearColor);
+            appendKey(key, in.clearColorValue);
+            appendKey(key, in.clearDepthStencil);
+            appendKey(key, in.clearDepthStencilValue);
+            appendKey(key, in.clearFormat);
+        },
+            [&](const CompilerExternalResourceNode &en)
         {
-            tn->desc.desc.Flags |=
-                D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-        }
+            // rscs of history rings are created by the compiler.
+            // their states are inferred from pass usages
+
+            if(en.historyRing >= 0)
+            {
+                auto &ring = historyRings_[en.historyRing];
+
+                auto desc = ring.desc.desc;
+                if(ring.desc.relativeSize)
+                {
+                    desc.Width  = 0;
+                    desc.Height = 0;
+                }
+
+                appendKey(key, 'H');
+                appendKey(key, en.historyRing);
+                appendKey(key, ring.historyLength);
+                appendKey(key, desc);
+                appendKey(key, ring.desc.relativeSize.has_value());
+                if(ring.desc.relativeSize)
+                {
+                    appendKey(key, ring.desc.relativeSize->widthScale);
+                    appendKey(key, ring.desc.relativeSize->heightScale);
+                }
+                return;
+            }
+
+            // view formats are inferred from external rsc descs.
+            // default viewports are updated when the rsc is resized,
+            // so texture sizes are not part of the structure
+
+            appendKey(key, 'E');
+            appendKey(key, en.rsc != nullptr);
+            if(en.rsc)
+            {
+                auto desc = en.rsc->GetDesc();
+                if(desc.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER)
+                {
+                    desc.Width  = 0;
+                    desc.Height = 0;
+                }
+                appendKey(key, desc);
+            }
+            appendKey(key, en.initialState);
+            appendKey(key, en.finalState);
+        });
     }
-    
-    // fill clear value
 
-    auto tn = rscs_[rscUsage.idx.idx]
-        .as_if<CompilerInternalResourceNode>();
+    // passes
 
-    if(!rscUsage.rtdsBinding.is<std::monostate>() &&
-        tn && !tn->clearColor && !tn->clearDepthStencil)
+    appendKey(key, passes_.size());
+    for(auto &pass : passes_)
     {
-        const DXGI_FORMAT rtdsFmt = match_variant(rscUsage.viewDesc,
-            [&](const _internalSRV &)   { return DXGI_FORMAT_UNKNOWN; },
-            [&](const _internalUAV &)   { return DXGI_FORMAT_UNKNOWN; },
-            [&](const _internalRTV &r)  { return r.desc.Format; },
-            [&](const _internalDSV &d)  { return d.desc.Format; },
-            [&](const std::monostate &) { return DXGI_FORMAT_UNKNOWN; });
+        appendKey(key, pass.isGraphics);
+        appendKey(key, pass.hasSideEffect);
+        appendKey(key, pass.isAsyncCompute);
+        appendKey(key, pass.isCopy);
+        appendKey(key, pass.isResolve);
+        appendKey(key, pass.isStatic);
+        appendKey(key, pass.chunkCount);
+
+        appendKey(key, pass.rscs.size());
+        for(auto &rscUsage : pass.rscs)
+        {
+            appendKey(key, rscUsage.idx);
+            appendKey(key, rscUsage.inState);
 
-        const DXGI_FORMAT clearFormat = rtdsFmt != DXGI_FORMAT_UNKNOWN ?
+            match_variant(rscUsage.viewDesc,
+                [&](const _internalSRV &v)
+            {
+                appendKey(key, 'S');
+                appendKey(key, v.desc);
+                appendKey(key, v.scope);
+            },
+                [&](const _internalUAV &v)
+            {
+                appendKey(key, 'U');
+                appendKey(key, v.desc);
+                appendKey(key, v.overlap);
+                appendKey(key, v.overwrite);
+            },
+                [&](const _internalRTV &v)
+            {
+                appendKey(key, 'R');
+                appendKey(key, v.desc);
+            },
+                [&](const _internalDSV &v)
+            {
+                appendKey(key, 'D');
+                appendKey(key, v.desc);
+            },
+                [&](const std::monostate &) { appendKey(key, 'N'); });
+
+            match_variant(rscUsage.rtdsBinding,
+                [&](const FrameGraphPassNode::PassResource::RTB &rtb)
+            {
+                appendKey(key, 'R');
+                appendKey(key, rtb.clear);
+                appendKey(key, rtb.clearColor);
+            },
+                [&](const FrameGraphPassNode::PassResource::DSB &dsb)
+            {
+                appendKey(key, 'D');
+                appendKey(key, dsb.clearDepth);
+                appendKey(key, dsb.clearStencil);
+                appendKey(key, dsb.clearDethpStencil);
+                appendKey(key, dsb.readOnly);
+            },
+                [&](const std::monostate &) { appendKey(key, 'N'); });
+        }
+
+        appendKey(key, pass.defaultViewport);
+        appendKey(key, pass.viewports.size());
+        for(auto &vp : pass.viewports)
+            appendKey(key, vp);
+
+        appendKey(key, pass.defaultScissor);
+        appendKey(key, pass.scissors.size());
+        for(auto &sc : pass.scissors)
+            appendKey(key, sc);
+    }
+
+    return key;
+}
+
+void FrameGraphCompiler::rebindCompiledGraph(FrameGraphData &graph) const
+{
+    for(size_t i = 0; i < graph.passNodes.size(); ++i)
+    {
+        auto &pass = passes_[graph.passDeclIndices[i].idx];
+        graph.passNodes[i].rebind(
+            pass.passFunc, pass.pipelineState, pass.rootSignature);
+        graph.passNames[i] = getPassName(pass);
+    }
+
+    for(size_t i = 0; i < rscs_.size(); ++i)
+    {
+        auto en = rscs_[i].as_if<CompilerExternalResourceNode>();
+        if(en && en->historyRing < 0)
+        {
+            graph.rscNodes[i].setExternalResource(en->rsc);
+            updateInferredViewports(graph, { static_cast<int32_t>(i) });
+        }
+    }
+}
+
+void FrameGraphCompiler::resizeCompiledGraph(
+    FrameGraphData    &graph,
+    UINT               backbufferWidth,
+    UINT               backbufferHeight,
+    ResourceAllocator &rscAlloc,
+    ResourceReleaser  &relativeRscReleaser)
+{
+    graph.backbufferWidth  = backbufferWidth;
+    graph.backbufferHeight = backbufferHeight;
+
+    // re-plan transient memory of relative rscs.
+    // rscIdx of candidates is index in graph.relativeRscs
+
+    std::map<D3D12_HEAP_FLAGS, std::vector<TransientCandidate>>
+        heapFlagsToCandidates;
+    UINT64 byteSizeBeforeAliasing = 0;
+
+    for(size_t i = 0; i < graph.relativeRscs.size(); ++i)
+    {
+        auto &relativeRsc = graph.relativeRscs[i];
+        resolveBackbufferRelativeSize(
+            relativeRsc.desc.desc, relativeRsc.size,
+            backbufferWidth, backbufferHeight);
+
+        if(relativeRsc.firstPass < 0)
+            continue;
+
+        TransientCandidate candidate;
+        candidate.rscIdx    = i;
+        candidate.firstPass = relativeRsc.firstPass;
+        candidate.lastPass  = relativeRsc.lastPass;
+        candidate.allocInfo = rscAlloc.getAllocationInfo(
+            relativeRsc.desc.desc);
+
+        heapFlagsToCandidates[getTransientHeapFlags(relativeRsc.desc.desc)]
+            .push_back(candidate);
+
+        byteSizeBeforeAliasing += candidate.allocInfo.SizeInBytes;
+    }
+
+    std::vector<TransientRscPlacement> placements(graph.relativeRscs.size());
+    std::vector<D3D12MA::Allocation *> transientHeaps;
+    UINT64 byteSizeAfterAliasing = 0;
+
+    for(auto &[heapFlags, candidates] : heapFlagsToCandidates)
+    {
+        TransientHeap heap;
+        heap.heapFlags = heapFlags;
+        heap.relative  = true;
+
+        packTransientHeap(
+            candidates, static_cast<int>(transientHeaps.size()),
+            placements, heap);
+
+        auto memory = rscAlloc.allocMemory(
+            heap.byteSize, heap.alignment, heap.heapFlags);
+        relativeRscReleaser.add(rscAlloc, memory);
+        transientHeaps.push_back(memory);
+
+        byteSizeAfterAliasing += heap.byteSize;
+    }
+
+    auto &stats = graph.statistics;
+    stats.transientMemoryBeforeAliasing =
+        stats.transientMemoryBeforeAliasing -
+        graph.relativeTransientMemoryBeforeAliasing + byteSizeBeforeAliasing;
+    stats.transientMemoryAfterAliasing =
+        stats.transientMemoryAfterAliasing -
+        graph.relativeTransientMemoryAfterAliasing + byteSizeAfterAliasing;
+
+    graph.relativeTransientMemoryBeforeAliasing = byteSizeBeforeAliasing;
+    graph.relativeTransientMemoryAfterAliasing  = byteSizeAfterAliasing;
+
+    // recreate relative rscs
+
+    for(size_t i = 0; i < graph.relativeRscs.size(); ++i)
+    {
+        const auto &relativeRsc = graph.relativeRscs[i];
+        const auto &placement   = placements[i];
+
+        ComPtr<ID3D12Resource> d3dRsc;
+        if(placement.heapIdx >= 0)
+        {
+            d3dRsc = rscAlloc.allocPlacedResource(
+                transientHeaps[placement.heapIdx], placement.offset,
+                relativeRsc.desc, relativeRsc.initialState);
+            relativeRscReleaser.add(d3dRsc);
+        }
+        else
+        {
+            d3dRsc = rscAlloc.allocResource(
+                relativeRsc.desc, relativeRsc.initialState);
+            relativeRscReleaser.add(rscAlloc, d3dRsc);
+        }
+
+        graph.rscNodes[relativeRsc.rscIdx] =
+            FrameGraphResourceNode(false, std::move(d3dRsc));
+
+        // aliasing may change with the new placement
+
+        if(relativeRsc.firstPass >= 0)
+        {
+            auto &passRsc = graph.passRscs[relativeRsc.firstPassRsc];
+
+            if(passRsc.aliasingBarrier)
+                --stats.aliasedRscCount;
+            if(placement.aliased)
+                ++stats.aliasedRscCount;
+
+            passRsc.aliasingBarrier = placement.aliased;
+
+            for(auto &r : graph.passRscs)
+            {
+                if(r.rscIdx.idx == relativeRsc.rscIdx && r.firstUse)
+                {
+                    r.discard = placement.aliased && isDiscardNeeded(
+                        r.rtdsBinding, r.inState,
+                        relativeRsc.desc.desc.Flags);
+
+                    r.discardState = r.discard ?
+                        getDiscardState(r.inState, relativeRsc.desc.desc.Flags) :
+                        D3D12_RESOURCE_STATES{};
+
+                    updateBeginAccess(r);
+                }
+            }
+        }
+
+        updateInferredViewports(graph, { relativeRsc.rscIdx });
+    }
+
+    // new aliasing barriers & discards may separate merged passes
+
+    if(stats.mergedPassCount)
+        mergePasses(graph);
+
+    // recreate relative history rings. their history is lost
+
+    for(auto &ring : graph.historyRings)
+    {
+        if(!ring.relativeSize)
+            continue;
+
+        resolveBackbufferRelativeSize(
+            ring.desc.desc, *ring.relativeSize,
+            backbufferWidth, backbufferHeight);
+
+        allocHistoryRing(ring, rscAlloc, relativeRscReleaser);
+        bindHistoryRing(graph, ring);
+
+        for(size_t k = 0; k < ring.rscs.size(); ++k)
+        {
+            updateInferredViewports(
+                graph, { ring.firstRsc + static_cast<int32_t>(k) });
+        }
+    }
+}
+
+void FrameGraphCompiler::rotateHistoryRings(FrameGraphData &graph)
+{
+    for(auto &ring : graph.historyRings)
+    {
+        ring.frame = (ring.frame + 1) % ring.rscs.size();
+        bindHistoryRing(graph, ring);
+    }
+}
+
+void FrameGraphCompiler::updateInferredViewports(
+    FrameGraphData &graph, ResourceIndex rsc)
+{
+    D3D12_RESOURCE_DESC desc = {};
+    bool hasDesc = false;
+
+    for(auto &inferredViewport : graph.inferredViewports)
+    {
+        if(inferredViewport.rscIdx != rsc.idx)
+            continue;
+
+        if(!hasDesc)
+        {
+            auto d3dRsc = graph.rscNodes[rsc.idx].getD3DResource();
+            if(!d3dRsc)
+                return;
+
+            desc    = d3dRsc->GetDesc();
+            hasDesc = true;
+        }
+
+        if(inferredViewport.width  == desc.Width &&
+           inferredViewport.height == desc.Height)
+            continue;
+
+        inferredViewport.width  = desc.Width;
+        inferredViewport.height = desc.Height;
+
+        graph.passNodes[inferredViewport.passIdx].updateDefaultViewport(
+            inferDefaultViewportAndScissor(desc),
+            inferredViewport.viewport, inferredViewport.scissor);
+    }
+}
+
+void FrameGraphCompiler::clearExternalResources()
+{
+    for(auto &rsc : rscs_)
+    {
+        auto en = rsc.as_if<CompilerExternalResourceNode>();
+        if(en && en->historyRing < 0)
+            en->rsc = nullptr;
+    }
+}
+
+void FrameGraphCompiler::createHistoryRings(
+    FrameGraphData    &graph,
+    ResourceAllocator &rscAlloc,
+    ResourceReleaser  &rscReleaser,
+    ResourceReleaser  &relativeRscReleaser)
+{
+    for(size_t r = 0; r < historyRings_.size(); ++r)
+    {
+        auto &compilerRing = historyRings_[r];
+
+        auto isInRing = [&](ResourceIndex idx)
+        {
+            return compilerRing.first.idx <= idx.idx &&
+                   idx.idx < compilerRing.first.idx + compilerRing.historyLength;
+        };
+
+        FrameGraphHistoryRing ring;
+        ring.firstRsc     = compilerRing.first.idx;
+        ring.relativeSize = compilerRing.desc.relativeSize;
+        ring.desc.desc    = compilerRing.desc.desc;
+        ring.rscs.resize(compilerRing.historyLength);
+
+        if(ring.relativeSize)
+        {
+            resolveBackbufferRelativeSize(
+                ring.desc.desc, *ring.relativeSize,
+                backbufferWidth_, backbufferHeight_);
+        }
+
+        // the rsc written in this frame ends in the state of its last
+        // usage, and is read in that state in the next frame.
+        // rscs of the ring are created with flags required by all usages
+
+        bool hasCurrentUsage = false;
+        bool hasHistoryUsage = false;
+
+        for(auto &pass : passes_)
+        {
+            for(auto &rscUsage : pass.rscs)
+            {
+                if(!isInRing(rscUsage.idx))
+                    continue;
+
+                if(rscUsage.idx.idx == compilerRing.first.idx)
+                {
+                    ring.state = rscUsage.inState;
+                    hasCurrentUsage = true;
+                }
+                else if(!hasCurrentUsage && !hasHistoryUsage)
+                {
+                    ring.state = rscUsage.inState;
+                    hasHistoryUsage = true;
+                }
+
+                auto &flags = ring.desc.desc.Flags;
+                match_variant(rscUsage.viewDesc,
+                    [&](const _internalRTV &)
+                {
+                    flags |= D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+                },
+                    [&](const _internalDSV &)
+                {
+                    flags |= D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+                },
+                    [&](const _internalUAV &)
+                {
+                    flags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+                },
+                    [&](const auto &) { });
+            }
+        }
+
+        if(!hasCurrentUsage && !hasHistoryUsage)
+            ring.state = D3D12_RESOURCE_STATE_COMMON;
+
+        for(int32_t k = 0; k < compilerRing.historyLength; ++k)
+        {
+            auto &en = rscs_[compilerRing.first.idx + k]
+                .as<CompilerExternalResourceNode>();
+            en.initialState = ring.state;
+            en.finalState   = ring.state;
+        }
+
+        allocHistoryRing(
+            ring, rscAlloc,
+            ring.relativeSize ? relativeRscReleaser : rscReleaser);
+
+        // compiled rsc nodes are created from the rscs bound here
+
+        const size_t n = ring.rscs.size();
+        for(size_t k = 0; k < n; ++k)
+        {
+            rscs_[compilerRing.first.idx + k]
+                .as<CompilerExternalResourceNode>().rsc =
+                    ring.rscs[(ring.frame + n - k) % n];
+        }
+
+        graph.historyRings.push_back(std::move(ring));
+    }
+}
+
+void FrameGraphCompiler::allocHistoryRing(
+    FrameGraphHistoryRing &ring,
+    ResourceAllocator     &rscAlloc,
+    ResourceReleaser      &rscReleaser)
+{
+    for(auto &rsc : ring.rscs)
+    {
+        rsc = rscAlloc.allocResource(ring.desc, ring.state);
+        rscReleaser.add(rscAlloc, rsc);
+    }
+
+    ring.frame = 0;
+}
+
+void FrameGraphCompiler::bindHistoryRing(
+    FrameGraphData &graph, const FrameGraphHistoryRing &ring)
+{
+    const size_t n = ring.rscs.size();
+    for(size_t k = 0; k < n; ++k)
+    {
+        graph.rscNodes[ring.firstRsc + k].setHistoryResource(
+            ring.rscs[(ring.frame + n - k) % n]);
+    }
+}
+
+void FrameGraphCompiler::createStateTracks()
+{
+    tracks_.clear();
+    rscTrackOffsets_.assign(rscs_.size() + 1, 0);
+
+    std::vector<std::vector<CompilerPassNode::RscInPass *>> rscUsages(
+        rscs_.size());
+
+    for(auto &pass : passes_)
+    {
+        for(auto &rscUsage : pass.rscs)
+        {
+            rscUsage.tracks.clear();
+            rscUsages[rscUsage.idx.idx].push_back(&rscUsage);
+        }
+    }
+
+    for(size_t r = 0; r < rscs_.size(); ++r)
+    {
+        rscTrackOffsets_[r] = static_cast<int32_t>(tracks_.size());
+
+        const auto &usages = rscUsages[r];
+
+        auto addTrack = [&]
+        {
+            StateTrack track;
+            track.rsc = { static_cast<int32_t>(r) };
+            tracks_.push_back(std::move(track));
+            return static_cast<int32_t>(tracks_.size() - 1);
+        };
+
+        // subresource layout
+
+        D3D12_RESOURCE_DESC desc = {};
+        bool isRelative = false;
+        bool isFinalStateDifferent = false;
+
+        match_variant(rscs_[r],
+            [&](const CompilerInternalResourceNode &in)
+        {
+            desc       = in.desc.desc;
+            isRelative = in.desc.relativeSize.has_value();
+        },
+            [&](const CompilerExternalResourceNode &en)
+        {
+            if(en.rsc)
+                desc = en.rsc->GetDesc();
+            if(en.historyRing >= 0)
+            {
+                isRelative = historyRings_[en.historyRing]
+                    .desc.relativeSize.has_value();
+            }
+            isFinalStateDifferent = en.initialState != en.finalState;
+        });
+
+        const bool isTexture =
+            desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE1D ||
+            desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE2D ||
+            desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+
+        UINT mipLevels = 1, arraySize = 1, planeCount = 1;
+        if(isTexture)
+        {
+            mipLevels = desc.MipLevels ?
+                desc.MipLevels : getFullMipmapChainLength(desc);
+            arraySize = desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ?
+                1 : desc.DepthOrArraySize;
+            planeCount = getPlaneCount(desc.Format);
+        }
+
+        // subresources covered by each usage. empty means all
+
+        std::vector<std::vector<UINT>> coveredSubrscs(usages.size());
+        bool isPartial = false;
+
+        for(size_t u = 0; isTexture && u < usages.size(); ++u)
+        {
+            auto range = getViewSubresourceRange(usages[u]->viewDesc);
+            if(usages[u]->firstMipOnly)
+                range.mipCount = 1;
+
+            const UINT mipBeg = (std::min)(range.firstMip, mipLevels);
+            const UINT mipEnd = range.mipCount == UINT(-1) ? mipLevels :
+                (std::min)(mipBeg + range.mipCount, mipLevels);
+
+            const UINT sliceBeg = (std::min)(range.firstSlice, arraySize);
+            const UINT sliceEnd = range.sliceCount == UINT(-1) ? arraySize :
+                (std::min)(sliceBeg + range.sliceCount, arraySize);
+
+            if(mipBeg == 0 && mipEnd == mipLevels &&
+               sliceBeg == 0 && sliceEnd == arraySize)
+                continue;
+
+            isPartial = true;
+            for(UINT p = 0; p < planeCount; ++p)
+            {
+                for(UINT a = sliceBeg; a < sliceEnd; ++a)
+                {
+                    for(UINT m = mipBeg; m < mipEnd; ++m)
+                    {
+                        coveredSubrscs[u].push_back(
+                            m + a * mipLevels + p * mipLevels * arraySize);
+                    }
+                }
+            }
+        }
+
+        // rscs used as a whole have a single track
+
+        if(!isPartial)
+        {
+            const int32_t t = addTrack();
+            for(auto usage : usages)
+                usage->tracks.push_back({ t });
+            continue;
+        }
+
+        // subresource indices would change with the backbuffer size
+
+        if(isRelative && !desc.MipLevels)
+        {
+            throw D3D12LabException(
+                "mipmap levels of backbuffer-relative rscs used by "
+                "subresources must be specified");
+        }
+
+        // group subresources by usages covering them.
+        // subresources of external rscs used by no pass are transitioned
+        // into the final state by the last user
+
+        const UINT subrscCount = mipLevels * arraySize * planeCount;
+        std::vector<std::vector<int>> coveringUsages(subrscCount);
+
+        for(size_t u = 0; u < usages.size(); ++u)
+        {
+            if(coveredSubrscs[u].empty())
+            {
+                for(auto &c : coveringUsages)
+                    c.push_back(static_cast<int>(u));
+            }
+            else
+            {
+                for(UINT subrsc : coveredSubrscs[u])
+                    coveringUsages[subrsc].push_back(static_cast<int>(u));
+            }
+        }
+
+        std::map<std::vector<int>, int32_t> usagesToTrack;
+        for(UINT subrsc = 0; subrsc < subrscCount; ++subrsc)
+        {
+            auto &covering = coveringUsages[subrsc];
+            if(covering.empty())
+            {
+                if(!isFinalStateDifferent)
+                    continue;
+                covering.push_back(static_cast<int>(usages.size() - 1));
+            }
+
+            auto it = usagesToTrack.find(covering);
+            if(it == usagesToTrack.end())
+            {
+                const int32_t t = addTrack();
+                for(int u : covering)
+                    usages[u]->tracks.push_back({ t });
+                it = usagesToTrack.insert({ covering, t }).first;
+            }
+
+            tracks_[it->second].subresources.push_back(subrsc);
+        }
+
+        for(int32_t t = rscTrackOffsets_[r];
+            t < static_cast<int32_t>(tracks_.size()); ++t)
+        {
+            if(tracks_[t].subresources.size() == subrscCount)
+                tracks_[t].subresources.clear();
+        }
+    }
+
+    rscTrackOffsets_.back() = static_cast<int32_t>(tracks_.size());
+}
+
+void FrameGraphCompiler::cullPasses(FrameGraphCompileStatistics &statistics)
+{
+    const size_t passCount = passes_.size();
+
+    // internal subresources not overwritten by their first users in each
+    // frame carry their content from the previous frame
+
+    std::vector<bool> isCarried(tracks_.size(), false);
+    std::vector<bool> isVisited(tracks_.size(), false);
+
+    for(auto &pass : passes_)
+    {
+        for(auto &rscUsage : pass.rscs)
+        {
+            for(auto &trackUsage : rscUsage.tracks)
+            {
+                const int32_t t = trackUsage.track;
+                if(isVisited[t])
+                    continue;
+
+                isVisited[t] = true;
+                isCarried[t] =
+                    rscs_[rscUsage.idx.idx].is<CompilerInternalResourceNode>() &&
+                    !isOverwritingUsage(
+                        rscUsage, getRscFormat(rscUsage.idx.idx));
+            }
+        }
+    }
+
+    // walk backwards from external rscs and passes with side effects
+
+    std::vector<bool> isAlive(passCount);
+    for(size_t i = 0; i < passCount; ++i)
+        isAlive[i] = passes_[i].hasSideEffect;
+
+    for(bool changed = true; changed;)
+    {
+        changed = false;
+
+        // carried subresources are needed by alive passes in the next frame
+
+        std::vector<bool> isNeeded(tracks_.size(), false);
+        for(size_t i = 0; i < passCount; ++i)
+        {
+            if(!isAlive[i])
+                continue;
+
+            for(auto &rscUsage : passes_[i].rscs)
+            {
+                for(auto &trackUsage : rscUsage.tracks)
+                {
+                    if(isCarried[trackUsage.track])
+                        isNeeded[trackUsage.track] = true;
+                }
+            }
+        }
+
+        for(size_t i = passCount; i-- > 0;)
+        {
+            auto &pass = passes_[i];
+
+            bool alive = isAlive[i];
+            for(auto &rscUsage : pass.rscs)
+            {
+                if(!isWriteState(rscUsage.inState))
+                    continue;
+
+                if(rscs_[rscUsage.idx.idx].is<CompilerExternalResourceNode>())
+                    alive = true;
+
+                for(auto &trackUsage : rscUsage.tracks)
+                {
+                    if(isNeeded[trackUsage.track])
+                        alive = true;
+                }
+            }
+
+            if(!alive)
+                continue;
+
+            if(!isAlive[i])
+            {
+                isAlive[i] = true;
+                changed = true;
+            }
+
+            for(auto &rscUsage : pass.rscs)
+            {
+                for(auto &trackUsage : rscUsage.tracks)
+                    isNeeded[trackUsage.track] = true;
+            }
+        }
+    }
+
+    // remove dead passes
+
+    std::vector<CompilerPassNode> alivePasses;
+    alivePasses.reserve(passCount);
+
+    for(size_t i = 0; i < passCount; ++i)
+    {
+        if(isAlive[i])
+            alivePasses.push_back(std::move(passes_[i]));
+        else
+            statistics.culledPasses.push_back(passes_[i].index);
+    }
+
+    passes_.swap(alivePasses);
+}
+
+void FrameGraphCompiler::reorderPasses(
+    FrameGraphCompileStatistics &statistics)
+{
+    const size_t passCount = passes_.size();
+
+    // build dependency dag
+
+    std::vector<std::vector<size_t>> succs(passCount);
+    std::vector<size_t>              predCounts(passCount, 0);
+
+    auto addEdge = [&](size_t from, size_t to)
+    {
+        if(from != to)
+        {
+            succs[from].push_back(to);
+            ++predCounts[to];
+        }
+    };
+
+    struct RscAccess
+    {
+        int lastWriter = -1;
+        std::vector<size_t> readersAfterLastWriter;
+    };
+
+    // accesses of each state track. passes using disjoint subresources
+    // of a rsc do not depend on each other
+
+    std::vector<RscAccess> trackAccesses(tracks_.size());
+    int lastSideEffectPass = -1;
+
+    for(size_t i = 0; i < passCount; ++i)
+    {
+        auto &pass = passes_[i];
+
+        for(auto &rscUsage : pass.rscs)
+        {
+            for(auto &trackUsage : rscUsage.tracks)
+            {
+                auto &access = trackAccesses[trackUsage.track];
+
+                // read after write & write after write
+
+                if(access.lastWriter >= 0)
+                    addEdge(access.lastWriter, i);
+
+                if(isWriteState(rscUsage.inState))
+                {
+                    // write after read
+
+                    for(auto r : access.readersAfterLastWriter)
+                        addEdge(r, i);
+
+                    access.readersAfterLastWriter.clear();
+                    access.lastWriter = static_cast<int>(i);
+                }
+                else
+                    access.readersAfterLastWriter.push_back(i);
+            }
+        }
+
+        // side effects are invisible to the compiler. keep their order
+
+        if(pass.hasSideEffect)
+        {
+            if(lastSideEffectPass >= 0)
+                addEdge(lastSideEffectPass, i);
+            lastSideEffectPass = static_cast<int>(i);
+        }
+    }
+
+    // track states during scheduling
+
+    std::vector<D3D12_RESOURCE_STATES> rscStates(tracks_.size());
+    std::vector<bool>                  isRscStateKnown(tracks_.size());
+    std::vector<int>                   rscLastWritePos(tracks_.size());
+
+    auto resetRscStates = [&]
+    {
+        for(size_t i = 0; i < tracks_.size(); ++i)
+        {
+            match_variant(rscs_[tracks_[i].rsc.idx],
+                [&](const CompilerExternalResourceNode &en)
+            {
+                rscStates[i]       = en.initialState;
+                isRscStateKnown[i] = true;
+            },
+                [&](const CompilerInternalResourceNode &in)
+            {
+                // COMMON initial state will be inferred from the first user
+                rscStates[i]       = in.initialState;
+                isRscStateKnown[i] =
+                    in.initialState != D3D12_RESOURCE_STATE_COMMON;
+            });
+
+            rscLastWritePos[i] = -1;
+        }
+    };
+
+    auto countTransitions = [&](const CompilerPassNode &pass)
+    {
+        size_t ret = 0;
+        for(auto &rscUsage : pass.rscs)
+        {
+            for(auto &trackUsage : rscUsage.tracks)
+            {
+                const int32_t t = trackUsage.track;
+                if(isRscStateKnown[t] && rscStates[t] != rscUsage.inState)
+                    ++ret;
+            }
+        }
+        return ret;
+    };
+
+    auto getLatestProducerPos = [&](const CompilerPassNode &pass)
+    {
+        int ret = -1;
+        for(auto &rscUsage : pass.rscs)
+        {
+            for(auto &trackUsage : rscUsage.tracks)
+                ret = (std::max)(ret, rscLastWritePos[trackUsage.track]);
+        }
+        return ret;
+    };
+
+    auto schedule = [&](const CompilerPassNode &pass, int pos)
+    {
+        for(auto &rscUsage : pass.rscs)
+        {
+            for(auto &trackUsage : rscUsage.tracks)
+            {
+                const int32_t t = trackUsage.track;
+                rscStates[t]       = rscUsage.inState;
+                isRscStateKnown[t] = true;
+
+                if(isWriteState(rscUsage.inState))
+                    rscLastWritePos[t] = pos;
+            }
+        }
+    };
+
+    // transitions in declaration order
+
+    resetRscStates();
+    for(size_t i = 0; i < passCount; ++i)
+    {
+        statistics.transitionsInDeclaredOrder += countTransitions(passes_[i]);
+        schedule(passes_[i], static_cast<int>(i));
+    }
+
+    // list scheduling. among ready passes, prefer:
+    // 1. fewer state transitions
+    // 2. closer to its producers
+    // 3. earlier in declaration order
+
+    resetRscStates();
+
+    std::vector<size_t> readyPasses;
+    for(size_t i = 0; i < passCount; ++i)
+    {
+        if(!predCounts[i])
+            readyPasses.push_back(i);
+    }
+
+    std::vector<size_t> order;
+    order.reserve(passCount);
+
+    while(!readyPasses.empty())
+    {
+        size_t bestReadyIdx    = 0;
+        size_t bestTransitions = 0;
+        int    bestProducerPos = -1;
+
+        for(size_t ri = 0; ri < readyPasses.size(); ++ri)
+        {
+            const auto &pass = passes_[readyPasses[ri]];
+
+            const size_t transitions = countTransitions(pass);
+            const int producerPos    = getLatestProducerPos(pass);
+
+            bool isBetter;
+            if(ri == 0)
+                isBetter = true;
+            else if(transitions != bestTransitions)
+                isBetter = transitions < bestTransitions;
+            else if(producerPos != bestProducerPos)
+                isBetter = producerPos > bestProducerPos;
+            else
+                isBetter = readyPasses[ri] < readyPasses[bestReadyIdx];
+
+            if(isBetter)
+            {
+                bestReadyIdx    = ri;
+                bestTransitions = transitions;
+                bestProducerPos = producerPos;
+            }
+        }
+
+        const size_t passIdx = readyPasses[bestReadyIdx];
+        readyPasses.erase(readyPasses.begin() + bestReadyIdx);
+
+        statistics.transitionsInCompiledOrder += bestTransitions;
+        schedule(passes_[passIdx], static_cast<int>(order.size()));
+        order.push_back(passIdx);
+
+        for(auto s : succs[passIdx])
+        {
+            if(!--predCounts[s])
+                readyPasses.push_back(s);
+        }
+    }
+
+    assert(order.size() == passCount);
+
+    // apply new order
+
+    std::vector<CompilerPassNode> orderedPasses;
+    orderedPasses.reserve(passCount);
+    for(auto i : order)
+        orderedPasses.push_back(std::move(passes_[i]));
+
+    passes_.swap(orderedPasses);
+}
+
+void FrameGraphCompiler::assignQueues(
+    const FrameGraphCompileOptions &options,
+    FrameGraphCompileStatistics    &statistics)
+{
+    // first user of each rsc, and first & last user of each state track
+
+    std::vector<int> firstRscUsers(rscs_.size(), -1);
+    std::vector<int> firstUsers(tracks_.size(), -1);
+    std::vector<int> lastUsers (tracks_.size(), -1);
+
+    for(size_t i = 0; i < passes_.size(); ++i)
+    {
+        for(auto &rscUsage : passes_[i].rscs)
+        {
+            const int32_t r = rscUsage.idx.idx;
+            if(firstRscUsers[r] < 0)
+                firstRscUsers[r] = static_cast<int>(i);
+
+            for(auto &trackUsage : rscUsage.tracks)
+            {
+                const int32_t t = trackUsage.track;
+                if(firstUsers[t] < 0)
+                    firstUsers[t] = static_cast<int>(i);
+                lastUsers[t] = static_cast<int>(i);
+            }
+        }
+    }
+
+    for(size_t i = 0; i < passes_.size(); ++i)
+    {
+        auto &pass = passes_[i];
+        pass.queue = FrameGraphQueue::Graphics;
+
+        FrameGraphQueue queue;
+        bool enabled;
+
+        if(pass.isCopy)
+        {
+            queue   = FrameGraphQueue::Copy;
+            enabled = options.copyQueue;
+        }
+        else if(pass.isAsyncCompute)
+        {
+            queue   = FrameGraphQueue::Compute;
+            enabled = options.asyncCompute;
+        }
+        else
+            continue;
+
+        auto isSupported = [&](D3D12_RESOURCE_STATES state)
+        {
+            return isStateSupportedByQueue(queue, state);
+        };
+
+        // transitions from/into users on other queues can always be
+        // recorded by one of the two queues (see isTransitionHandedOff).
+        // transitions from/into initial/final states are recorded by
+        // this pass
+
+        bool supported = enabled;
+        for(auto &rscUsage : pass.rscs)
+        {
+            if(!supported)
+                break;
+
+            const int32_t r = rscUsage.idx.idx;
+            supported = isSupported(rscUsage.inState);
+
+            // COMMON initial state of internal rsc is inferred from
+            // the first user, which is supported if the first user is
+            // on the same queue
+
+            const auto in = rscs_[r].as_if<CompilerInternalResourceNode>();
+            const bool isInferred =
+                in && in->initialState == D3D12_RESOURCE_STATE_COMMON;
+
+            const bool isFirstRscUser = firstRscUsers[r] == static_cast<int>(i);
+            auto isInferredStateSupported = [&]
+            {
+                return isFirstRscUser ||
+                       passes_[firstRscUsers[r]].queue == queue;
+            };
+
+            for(auto &trackUsage : rscUsage.tracks)
+            {
+                const int32_t t = trackUsage.track;
+
+                if(firstUsers[t] == static_cast<int>(i))
+                {
+                    if(!isInferred)
+                        supported &= isSupported(getRscInitialState(r));
+                    else
+                        supported &= isInferredStateSupported();
+                }
+
+                if(lastUsers[t] == static_cast<int>(i))
+                {
+                    if(!isInferred)
+                        supported &= isSupported(getRscFinalState(r));
+                    else
+                        supported &= isInferredStateSupported();
+                }
+            }
+        }
+
+        if(supported)
+            pass.queue = queue;
+
+        if(pass.isCopy)
+        {
+            if(supported)
+                ++statistics.copyQueuePassCount;
+            else
+                ++statistics.demotedCopyPassCount;
+        }
+        else
+        {
+            if(supported)
+                ++statistics.asyncComputePassCount;
+            else
+                ++statistics.demotedAsyncComputePassCount;
+        }
+    }
+}
+
+void FrameGraphCompiler::inferRscCreationFlagAndClearValue(
+    CompilerPassNode::RscInPass &rscUsage)
+{
+    if(auto tn = rscs_[rscUsage.idx.idx].as_if
+        <CompilerInternalResourceNode>(); tn)
+    {
+        if(tn->initialState == D3D12_RESOURCE_STATE_COMMON)
+            tn->initialState = rscUsage.inState;
+
+        if(rscUsage.inState & D3D12_RESOURCE_STATE_RENDER_TARGET)
+        {
+            tn->desc.desc.Flags |=
+                D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+        }
+
+        if(rscUsage.inState & (D3D12_RESOURCE_STATE_DEPTH_WRITE |
+                               D3D12_RESOURCE_STATE_DEPTH_READ))
+        {
+            tn->desc.desc.Flags |=
+                D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL;
+        }
+
+        if(rscUsage.inState & D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+        {
+            tn->desc.desc.Flags |=
+                D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+        }
+    }
+    
+    // fill clear value
+
+    auto tn = rscs_[rscUsage.idx.idx]
+        .as_if<CompilerInternalResourceNode>();
+
+    if(!rscUsage.rtdsBinding.is<std::monostate>() &&
+        tn && !tn->clearColor && !tn->clearDepthStencil)
+    {
+        const DXGI_FORMAT rtdsFmt = match_variant(rscUsage.viewDesc,
+            [&](const _internalSRV &)   { return DXGI_FORMAT_UNKNOWN; },
+            [&](const _internalUAV &)   { return DXGI_FORMAT_UNKNOWN; },
+            [&](const _internalRTV &r)  { return r.desc.Format; },
+            [&](const _internalDSV &d)  { return d.desc.Format; },
+            [&](const std::monostate &) { return DXGI_FORMAT_UNKNOWN; });
+
+        const DXGI_FORMAT clearFormat = rtdsFmt != DXGI_FORMAT_UNKNOWN ?
                                         rtdsFmt : tn->desc.desc.Format;
         assert(clearFormat != DXGI_FORMAT_UNKNOWN);
 
-        if(!isTypeless(clearFormat))
+        if(!isTypeless(clearFormat))
+        {
+            if(auto rtb = rscUsage.rtdsBinding
+                .as_if<FrameGraphPassNode::PassResource::RTB>();
+                rtb)
+            {
+                tn->clearColor      = rtb->clear;
+                tn->clearColorValue = rtb->clearColor;
+                tn->clearFormat     = clearFormat;
+            }
+            else
+            {
+                assert(rscUsage.rtdsBinding.is<
+                    FrameGraphPassNode::PassResource::DSB>());
+                auto &dsb = rscUsage.rtdsBinding.as<
+                    FrameGraphPassNode::PassResource::DSB>();
+
+                if(!dsb.readOnly)
+                {
+                    tn->clearDepthStencil = dsb.clearDepth ||
+                        dsb.clearStencil;
+                    tn->clearDepthStencilValue = dsb.clearDethpStencil;
+                    tn->clearFormat = clearFormat;
+                }
+            }
+        }
+    }
+}
+
+FrameGraphCompiler::RscUsageInfo FrameGraphCompiler::collectRscUsages()
+{
+    RscUsageInfo info;
+    info.rscTempNodes.resize(rscs_.size());
+    info.trackTempNodes.resize(tracks_.size());
+
+    for(size_t i = 0; i < passes_.size(); ++i)
+    {
+        const PassIndex passIdx = { static_cast<int32_t>(i) };
+        auto &pass = passes_[i];
+
+        auto &gpuDescCount = hasPersistentGPUDescs(pass) ?
+            info.graphDescCount.gpu : info.frameDescCount.gpu;
+
+        for(auto &rscUsage : pass.rscs)
+        {
+            auto &tempRsc = info.rscTempNodes[rscUsage.idx.idx];
+
+            const int idxInRscUsers = static_cast<int>(tempRsc.users.size());
+            rscUsage.idxInRscUsers = idxInRscUsers;
+
+            tempRsc.users.push_back({ passIdx, rscUsage.inState });
+
+            for(auto &trackUsage : rscUsage.tracks)
+            {
+                auto &tempTrack = info.trackTempNodes[trackUsage.track];
+                trackUsage.idxInTrackUsers =
+                    static_cast<int>(tempTrack.users.size());
+                tempTrack.users.push_back({ passIdx, rscUsage.inState });
+
+                const auto uav = rscUsage.viewDesc.as_if<_internalUAV>();
+                tempTrack.uavOverlaps.push_back(
+                    uav ? uav->overlap : UAVOverlap::Serialize);
+            }
+
+            auto &descCount = rscs_[rscUsage.idx.idx]
+                .is<CompilerExternalResourceNode>() ?
+                    info.frameDescCount : info.graphDescCount;
+
+            match_variant(rscUsage.viewDesc,
+                [&](const _internalSRV &)  { ++gpuDescCount; },
+                [&](const _internalUAV &)  { ++gpuDescCount; },
+                [&](const _internalRTV &r) { ++descCount.rtv; },
+                [&](const _internalDSV &d) { ++descCount.dsv; },
+                [&](const std::monostate &) { });
+        }
+    }
+
+    // merge states of consecutive read-only users,
+    // so that a run of readers needs only one transition
+
+    for(auto &tempTrack : info.trackTempNodes)
+    {
+        auto &users = tempTrack.users;
+
+        size_t runBeg = 0;
+        while(runBeg < users.size())
+        {
+            if(isWriteState(users[runBeg].second))
+            {
+                ++runBeg;
+                continue;
+            }
+
+            D3D12_RESOURCE_STATES mergedState = users[runBeg].second;
+
+            // runs are not merged across queues, as the merged state
+            // may be unsupported by non-graphics queues
+
+            const FrameGraphQueue runQueue =
+                passes_[users[runBeg].first.idx].queue;
+
+            size_t runEnd = runBeg + 1;
+            while(runEnd < users.size() &&
+                  !isWriteState(users[runEnd].second) &&
+                  passes_[users[runEnd].first.idx].queue == runQueue)
+                mergedState |= users[runEnd++].second;
+
+            for(size_t i = runBeg; i < runEnd; ++i)
+                users[i].second = mergedState;
+
+            runBeg = runEnd;
+        }
+    }
+
+    // merged states of a usage may differ between its tracks.
+    // the first one is used for inferring initial states
+
+    for(auto &pass : passes_)
+    {
+        for(auto &rscUsage : pass.rscs)
+        {
+            if(rscUsage.tracks.empty())
+                continue;
+
+            auto &trackUsage = rscUsage.tracks.front();
+            rscUsage.inState = info.trackTempNodes[trackUsage.track]
+                .users[trackUsage.idxInTrackUsers].second;
+        }
+    }
+
+    return info;
+}
+
+void FrameGraphCompiler::checkTrackStatesInPasses(
+    const std::vector<TempRscNode> &trackTempNodes) const
+{
+    for(size_t t = 0; t < trackTempNodes.size(); ++t)
+    {
+        const auto &users = trackTempNodes[t].users;
+        for(size_t k = 1; k < users.size(); ++k)
+        {
+            if(users[k].first.idx == users[k - 1].first.idx &&
+               users[k].second != users[k - 1].second)
+            {
+                const auto &pass = passes_[users[k].first.idx];
+                throw D3D12LabException(
+                    "subresources of rsc " +
+                    std::to_string(tracks_[t].rsc.idx) +
+                    " are used with different states in " +
+                    getPassName(pass));
+            }
+        }
+    }
+}
+
+bool FrameGraphCompiler::hasPersistentGPUDescs(
+    const CompilerPassNode &pass) const
+{
+    for(auto &rscUsage : pass.rscs)
+    {
+        const bool isGPUView = rscUsage.viewDesc.is<_internalSRV>() ||
+                               rscUsage.viewDesc.is<_internalUAV>();
+        if(isGPUView &&
+           rscs_[rscUsage.idx.idx].is<CompilerExternalResourceNode>())
+            return false;
+    }
+    return true;
+}
+
+D3D12_RESOURCE_STATES FrameGraphCompiler::getRscInitialState(
+    size_t rscIdx) const
+{
+    return match_variant(rscs_[rscIdx],
+        [&](const CompilerExternalResourceNode &en)
+    {
+        return en.initialState;
+    },
+        [&](const CompilerInternalResourceNode &in)
+    {
+        return in.initialState;
+    });
+}
+
+D3D12_RESOURCE_STATES FrameGraphCompiler::getRscFinalState(
+    size_t rscIdx) const
+{
+    // internal rscs are transitioned back to their initial states
+
+    return match_variant(rscs_[rscIdx],
+        [&](const CompilerExternalResourceNode &en)
+    {
+        return en.finalState;
+    },
+        [&](const CompilerInternalResourceNode &in)
+    {
+        return in.initialState;
+    });
+}
+
+bool FrameGraphCompiler::isTransitionHandedOff(
+    const TempRscNode &tempNode, size_t userIdx) const
+{
+    if(!userIdx)
+        return false;
+
+    const auto &prevUser = tempNode.users[userIdx - 1];
+    const auto &thisUser = tempNode.users[userIdx];
+
+    const FrameGraphQueue prevQueue = passes_[prevUser.first.idx].queue;
+    const FrameGraphQueue thisQueue = passes_[thisUser.first.idx].queue;
+
+    // queue capabilities are nested (copy < compute < graphics). if the
+    // previous queue does not support the new state, this queue is more
+    // capable and supports the previous state
+
+    return prevUser.second != thisUser.second &&
+           prevQueue != thisQueue &&
+           isStateSupportedByQueue(prevQueue, thisUser.second);
+}
+
+bool FrameGraphCompiler::isUAVBarrierNeeded(
+    const TempRscNode &tempNode, size_t userIdx) const
+{
+    const UAVOverlap thisOverlap = tempNode.uavOverlaps[userIdx];
+    if(thisOverlap == UAVOverlap::NoOverlap)
+        return false;
+
+    // accesses before the graph are ordered by the caller's policy
+
+    if(!userIdx)
+        return true;
+
+    const auto &prevUser = tempNode.users[userIdx - 1];
+    const auto &thisUser = tempNode.users[userIdx];
+
+    // usages in the same pass access the rsc at the same time.
+    // users on different queues are ordered by fences, which also make
+    // the previous writes visible
+
+    if(prevUser.first.idx == thisUser.first.idx ||
+       passes_[prevUser.first.idx].queue != passes_[thisUser.first.idx].queue)
+        return false;
+
+    return !(thisOverlap == UAVOverlap::AppendOnly &&
+             tempNode.uavOverlaps[userIdx - 1] == UAVOverlap::AppendOnly);
+}
+
+std::vector<FrameGraphPassSync> FrameGraphCompiler::computePassSyncs(
+    const std::vector<TempRscNode> &trackTempNodes,
+    FrameGraphCompileStatistics    &statistics) const
+{
+    constexpr int GRAPHICS = static_cast<int>(FrameGraphQueue::Graphics);
+
+    std::vector<FrameGraphPassSync> syncs(passes_.size());
+    for(size_t i = 0; i < passes_.size(); ++i)
+        syncs[i].queue = passes_[i].queue;
+
+    auto queueOf = [&](int32_t passIdx)
+    {
+        return static_cast<int>(passes_[passIdx].queue);
+    };
+
+    // subresources of different state tracks are synchronized separately
+
+    for(size_t t = 0; t < tracks_.size(); ++t)
+    {
+        const auto &tempNode = trackTempNodes[t];
+        const auto &users    = tempNode.users;
+        if(users.empty())
+            continue;
+
+        const size_t r = tracks_[t].rsc.idx;
+
+        const D3D12_RESOURCE_STATES initialState = getRscInitialState(r);
+        const D3D12_RESOURCE_STATES finalState   = getRscFinalState(r);
+
+        // rscs used outside the graph or on multiple queues may be
+        // accessed by another queue in the previous frame
+
+        bool isUsedAcrossFrames = rscs_[r].is<CompilerExternalResourceNode>();
+        for(auto &user : users)
+        {
+            if(queueOf(user.first.idx) != queueOf(users.front().first.idx))
+                isUsedAcrossFrames = true;
+        }
+
+        // last user on each queue & last user modifying the rsc
+
+        int32_t lastQueueUsers[FRAME_GRAPH_QUEUE_COUNT];
+        for(auto &u : lastQueueUsers)
+            u = -1;
+
+        int32_t lastModifier = -1;
+
+        for(size_t k = 0; k < users.size(); ++k)
+        {
+            const int32_t passIdx = users[k].first.idx;
+            const int     queue   = queueOf(passIdx);
+
+            const D3D12_RESOURCE_STATES state     = users[k].second;
+            const D3D12_RESOURCE_STATES prevState =
+                k ? users[k - 1].second : initialState;
+
+            // transitions are modifications as well
+
+            const bool inTransition =
+                prevState != state && !isTransitionHandedOff(tempNode, k);
+
+            const bool outTransition = k + 1 < users.size() ?
+                isTransitionHandedOff(tempNode, k + 1) : state != finalState;
+
+            const bool modifies =
+                isWriteState(state) || inTransition || outTransition;
+
+            auto &sync = syncs[passIdx];
+
+            auto waitFor = [&](int32_t otherPassIdx)
+            {
+                auto &w = sync.waitPasses[queueOf(otherPassIdx)];
+                w = (std::max)(w, otherPassIdx);
+            };
+
+            if(modifies)
+            {
+                // after all previous accesses on other queues
+
+                for(int q = 0; q < FRAME_GRAPH_QUEUE_COUNT; ++q)
+                {
+                    if(q != queue && lastQueueUsers[q] >= 0)
+                        waitFor(lastQueueUsers[q]);
+                }
+            }
+            else if(lastModifier >= 0 && queueOf(lastModifier) != queue)
+                waitFor(lastModifier);
+
+            if(queue != GRAPHICS && lastQueueUsers[queue] < 0 &&
+               isUsedAcrossFrames)
+                sync.waitPrevFrame = true;
+
+            lastQueueUsers[queue] = passIdx;
+            if(modifies)
+                lastModifier = passIdx;
+        }
+    }
+
+    // remove waits covered by earlier waits on the same queue.
+    // waiting for any graphics pass also covers the previous frame
+
+    int32_t waited[FRAME_GRAPH_QUEUE_COUNT][FRAME_GRAPH_QUEUE_COUNT];
+    bool waitedPrevFrame[FRAME_GRAPH_QUEUE_COUNT];
+
+    for(int q = 0; q < FRAME_GRAPH_QUEUE_COUNT; ++q)
+    {
+        for(auto &w : waited[q])
+            w = -1;
+        waitedPrevFrame[q] = false;
+    }
+
+    for(auto &sync : syncs)
+    {
+        const int queue = static_cast<int>(sync.queue);
+
+        for(int q = 0; q < FRAME_GRAPH_QUEUE_COUNT; ++q)
+        {
+            if(sync.waitPasses[q] <= waited[queue][q])
+                sync.waitPasses[q] = -1;
+            else
+                waited[queue][q] = sync.waitPasses[q];
+        }
+
+        if(waitedPrevFrame[queue] || waited[queue][GRAPHICS] >= 0)
+            sync.waitPrevFrame = false;
+
+        waitedPrevFrame[queue] |= sync.waitPrevFrame;
+    }
+
+    // signal passes waited by others
+
+    for(auto &sync : syncs)
+    {
+        for(auto w : sync.waitPasses)
+        {
+            if(w >= 0)
+            {
+                syncs[w].signal = true;
+                ++statistics.crossQueueWaitCount;
+            }
+        }
+
+        if(sync.waitPrevFrame)
+            ++statistics.crossQueueWaitCount;
+    }
+
+    return syncs;
+}
+
+bool FrameGraphCompiler::canMergePasses(
+    const FrameGraphPassNode &a, const FrameGraphPassSync &syncA,
+    const FrameGraphPassNode &b, const FrameGraphPassSync &syncB)
+{
+    using PassResource = FrameGraphPassNode::PassResource;
+
+    const auto &dataA = a.getPassData();
+    const auto &dataB = b.getPassData();
+
+    if(!a.isGraphics() || !b.isGraphics() ||
+       dataA.chunkCount > 1 || dataB.chunkCount > 1 ||
+       dataA.renderPass != dataB.renderPass)
+        return false;
+
+    // merged passes are recorded in the same cmd list
+
+    if(syncA.queue != syncB.queue || syncA.signal || syncB.waitPrevFrame)
+        return false;
+
+    for(auto w : syncB.waitPasses)
+    {
+        if(w >= 0)
+            return false;
+    }
+
+    // no barrier is recorded after a or before b
+
+    for(auto &r : dataA.rscs)
+    {
+        if(r.inState != r.afterState || r.splitEndPass >= 0 ||
+           r.outUAVBarrier)
+            return false;
+    }
+
+    for(auto &r : dataB.rscs)
+    {
+        if(r.beforeState != r.inState || r.aliasingBarrier ||
+           r.uavBarrier || r.discard)
+            return false;
+    }
+
+    // the same rts/ds in the same order, and nothing cleared by b.
+    // uav writes are allowed by the whole render pass or not at all
+
+    auto getBindings = [](const FrameGraphPassNode::PassData &data)
+    {
+        std::vector<const PassResource *> bindings;
+        for(auto &r : data.rscs)
+        {
+            if(!r.rtdsBinding.is<std::monostate>())
+                bindings.push_back(&r);
+        }
+        return bindings;
+    };
+
+    auto hasUAV = [](const FrameGraphPassNode::PassData &data)
+    {
+        return std::any_of(data.rscs.begin(), data.rscs.end(),
+            [](const PassResource &r) { return r.viewDesc.is<_internalUAV>(); });
+    };
+
+    if(hasUAV(dataA) != hasUAV(dataB))
+        return false;
+
+    const auto bindingsA = getBindings(dataA);
+    const auto bindingsB = getBindings(dataB);
+
+    if(bindingsA.empty() || bindingsA.size() != bindingsB.size())
+        return false;
+
+    for(size_t i = 0; i < bindingsA.size(); ++i)
+    {
+        auto &ra = *bindingsA[i];
+        auto &rb = *bindingsB[i];
+
+        if(ra.rscIdx.idx != rb.rscIdx.idx)
+            return false;
+
+        const bool isSameBinding = match_variant(rb.rtdsBinding,
+            [&](const PassResource::RTB &rtb)
+        {
+            return ra.rtdsBinding.is<PassResource::RTB>() && !rtb.clear &&
+                   std::memcmp(
+                       &ra.viewDesc.as<_internalRTV>().desc,
+                       &rb.viewDesc.as<_internalRTV>().desc,
+                       sizeof(D3D12_RENDER_TARGET_VIEW_DESC)) == 0;
+        },
+            [&](const PassResource::DSB &dsb)
+        {
+            auto dsbA = ra.rtdsBinding.as_if<PassResource::DSB>();
+            return dsbA && dsbA->readOnly == dsb.readOnly &&
+                   !dsb.clearDepth && !dsb.clearStencil &&
+                   std::memcmp(
+                       &ra.viewDesc.as<_internalDSV>().desc,
+                       &rb.viewDesc.as<_internalDSV>().desc,
+                       sizeof(D3D12_DEPTH_STENCIL_VIEW_DESC)) == 0;
+        },
+            [&](const std::monostate &) { return false; });
+
+        if(!isSameBinding)
+            return false;
+    }
+
+    return true;
+}
+
+void FrameGraphCompiler::mergePasses(FrameGraphData &graph)
+{
+    using PassResource = FrameGraphPassNode::PassResource;
+
+    auto &nodes = graph.passNodes;
+
+    graph.statistics.mergedPassCount = 0;
+
+    size_t runBeg = 0;
+    for(size_t i = 1; i <= nodes.size(); ++i)
+    {
+        if(i < nodes.size() && canMergePasses(
+            nodes[i - 1], graph.passSyncs[i - 1],
+            nodes[i], graph.passSyncs[i]))
+            continue;
+
+        // [runBeg, i) are merged. ending accesses of a previous merging
+        // are reset, as the runs may have changed since then
+
+        for(size_t j = runBeg; j < i; ++j)
+        {
+            nodes[j].setMergedPasses(j > runBeg, j + 1 < i);
+
+            for(auto &r : nodes[j].getPassData().rscs)
+            {
+                match_variant(r.rtdsBinding,
+                    [&](PassResource::RTB &rtb)
+                {
+                    rtb.endAccess = rtb.passEndAccess;
+                },
+                    [&](PassResource::DSB &dsb)
+                {
+                    dsb.depthEndAccess   = dsb.depthPassEndAccess;
+                    dsb.stencilEndAccess = dsb.stencilPassEndAccess;
+                },
+                    [&](std::monostate &) { });
+            }
+        }
+
+        if(i - runBeg > 1)
         {
-            if(auto rtb = rscUsage.rtdsBinding
-                .as_if<FrameGraphPassNode::PassResource::RTB>();
-                rtb)
+            graph.statistics.mergedPassCount += i - runBeg - 1;
+
+            // the render pass begun by the first node ends after the last one
+
+            auto &first = nodes[runBeg].getPassData();
+            auto &last  = nodes[i - 1].getPassData();
+
+            auto lastRsc = last.rscs.begin();
+            for(auto &r : first.rscs)
             {
-                tn->clearColor      = rtb->clear;
-                tn->clearColorValue = rtb->clearColor;
-                tn->clearFormat     = clearFormat;
+                if(r.rtdsBinding.is<std::monostate>())
+                    continue;
+                while(lastRsc->rtdsBinding.is<std::monostate>())
+                    ++lastRsc;
+
+                match_variant(r.rtdsBinding,
+                    [&](PassResource::RTB &rtb)
+                {
+                    rtb.endAccess = lastRsc->rtdsBinding
+                        .as<PassResource::RTB>().passEndAccess;
+                },
+                    [&](PassResource::DSB &dsb)
+                {
+                    auto &lastDSB = lastRsc->rtdsBinding.as<PassResource::DSB>();
+                    dsb.depthEndAccess   = lastDSB.depthPassEndAccess;
+                    dsb.stencilEndAccess = lastDSB.stencilPassEndAccess;
+                },
+                    [&](std::monostate &) { });
+
+                ++lastRsc;
             }
-            else
+        }
+
+        runBeg = i;
+    }
+}
+
+D3D12_HEAP_FLAGS FrameGraphCompiler::getTransientHeapFlags(
+    const D3D12_RESOURCE_DESC &desc) noexcept
+{
+    // keep different kinds of rscs in different heaps,
+    // which is required by resource heap tier 1
+
+    if(desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+        return D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+
+    if(desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET |
+                     D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL))
+        return D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+
+    return D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+}
+
+bool FrameGraphCompiler::isTransientRsc(
+    size_t                          rscIdx,
+    const RscUsageInfo             &usageInfo) const
+{
+    const auto &tempNode = usageInfo.rscTempNodes[rscIdx];
+    if(tempNode.users.empty())
+        return false;
+
+    // lifetimes in pass order do not hold across queues running in parallel
+
+    for(auto &user : tempNode.users)
+    {
+        if(passes_[user.first.idx].queue != FrameGraphQueue::Graphics)
+            return false;
+    }
+
+    // subresources not overwritten by their first users in a frame may
+    // expect content of the last frame
+
+    for(int32_t t = rscTrackOffsets_[rscIdx];
+        t < rscTrackOffsets_[rscIdx + 1]; ++t)
+    {
+        const auto &tempTrack = usageInfo.trackTempNodes[t];
+        if(!tempTrack.users.empty() && !isOverwrittenByFirstUser(t, tempTrack))
+            return false;
+    }
+
+    return true;
+}
+
+FrameGraphCompiler::TransientMemoryInfo FrameGraphCompiler::planTransientMemory(
+    const RscUsageInfo             &usageInfo,
+    const ResourceAllocator        &rscAlloc) const
+{
+    TransientMemoryInfo ret;
+    ret.placements.resize(rscs_.size());
+
+    // collect transient rscs.
+    // backbuffer-relative rscs are put into their own heaps
+
+    using HeapKey = std::pair<D3D12_HEAP_FLAGS, bool>;
+    std::map<HeapKey, std::vector<TransientCandidate>> heapKeyToCandidates;
+
+    for(size_t i = 0; i < rscs_.size(); ++i)
+    {
+        auto in = rscs_[i].as_if<CompilerInternalResourceNode>();
+        if(!in || !isTransientRsc(i, usageInfo))
+            continue;
+
+        const auto &users = usageInfo.rscTempNodes[i].users;
+
+        TransientCandidate candidate;
+        candidate.rscIdx    = i;
+        candidate.firstPass = users.front().first.idx;
+        candidate.lastPass  = users.back().first.idx;
+        candidate.allocInfo = rscAlloc.getAllocationInfo(in->desc.desc);
+
+        const bool isRelative = in->desc.relativeSize.has_value();
+        const HeapKey heapKey = {
+            getTransientHeapFlags(in->desc.desc), isRelative };
+        heapKeyToCandidates[heapKey].push_back(candidate);
+
+        ret.byteSizeBeforeAliasing += candidate.allocInfo.SizeInBytes;
+        if(isRelative)
+        {
+            ret.relativeByteSizeBeforeAliasing +=
+                candidate.allocInfo.SizeInBytes;
+        }
+    }
+
+    // pack rscs of disjoint lifetimes into the same memory
+
+    for(auto &[heapKey, candidates] : heapKeyToCandidates)
+    {
+        TransientHeap heap;
+        heap.heapFlags = heapKey.first;
+        heap.relative  = heapKey.second;
+
+        packTransientHeap(
+            candidates, static_cast<int>(ret.heaps.size()),
+            ret.placements, heap);
+
+        ret.byteSizeAfterAliasing += heap.byteSize;
+        ret.heaps.push_back(heap);
+    }
+
+    return ret;
+}
+
+void FrameGraphCompiler::packTransientHeap(
+    std::vector<TransientCandidate>    &candidates,
+    int                                 heapIdx,
+    std::vector<TransientRscPlacement> &placements,
+    TransientHeap                      &heap)
+{
+    auto alignUp = [](UINT64 offset, UINT64 align)
+    {
+        return (offset + align - 1) / align * align;
+    };
+
+    // larger rscs are placed first
+
+    std::sort(candidates.begin(), candidates.end(),
+        [](const TransientCandidate &a, const TransientCandidate &b)
+    {
+        if(a.allocInfo.SizeInBytes != b.allocInfo.SizeInBytes)
+            return a.allocInfo.SizeInBytes > b.allocInfo.SizeInBytes;
+        return a.rscIdx < b.rscIdx;
+    });
+
+    for(size_t ci = 0; ci < candidates.size(); ++ci)
+    {
+        const auto &c = candidates[ci];
+
+        // memory ranges occupied by placed rscs alive at the same time
+
+        std::vector<std::pair<UINT64, UINT64>> occupied;
+        for(size_t pi = 0; pi < ci; ++pi)
+        {
+            const auto &p = candidates[pi];
+            if(p.firstPass <= c.lastPass && c.firstPass <= p.lastPass)
             {
-                assert(rscUsage.rtdsBinding.is<
-                    FrameGraphPassNode::PassResource::DSB>());
-                auto &dsb = rscUsage.rtdsBinding.as<
-                    FrameGraphPassNode::PassResource::DSB>();
+                const UINT64 beg = placements[p.rscIdx].offset;
+                occupied.push_back(
+                    { beg, beg + p.allocInfo.SizeInBytes });
+            }
+        }
+        std::sort(occupied.begin(), occupied.end());
+
+        // find the lowest aligned offset where the rsc fits
 
-                tn->clearDepthStencil = dsb.clearDepth ||
-                    dsb.clearStencil;
-                tn->clearDepthStencilValue = dsb.clearDethpStencil;
-                tn->clearFormat = clearFormat;
+        UINT64 offset = 0;
+        for(auto &o : occupied)
+        {
+            if(offset + c.allocInfo.SizeInBytes <= o.first)
+                break;
+            if(o.second > offset)
+                offset = alignUp(o.second, c.allocInfo.Alignment);
+        }
+
+        auto &placement = placements[c.rscIdx];
+        placement.heapIdx = heapIdx;
+        placement.offset  = offset;
+
+        heap.byteSize = (std::max)(
+            heap.byteSize, offset + c.allocInfo.SizeInBytes);
+        heap.alignment = (std::max)(
+            heap.alignment, c.allocInfo.Alignment);
+    }
+
+    // mark rscs sharing memory with others
+
+    for(size_t ai = 0; ai < candidates.size(); ++ai)
+    {
+        const auto &a = candidates[ai];
+        auto &pa = placements[a.rscIdx];
+
+        for(size_t bi = ai + 1; bi < candidates.size(); ++bi)
+        {
+            const auto &b = candidates[bi];
+            auto &pb = placements[b.rscIdx];
+
+            if(pa.offset < pb.offset + b.allocInfo.SizeInBytes &&
+               pb.offset < pa.offset + a.allocInfo.SizeInBytes)
+            {
+                pa.aliased = true;
+                pb.aliased = true;
             }
         }
     }
+
+    heap.byteSize = alignUp(
+        heap.byteSize, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
 }
 
-FrameGraphCompiler::RscUsageInfo FrameGraphCompiler::collectRscUsages()
+bool FrameGraphCompiler::isDiscardNeeded(
+    const FrameGraphPassNode::PassResource::RTDSBinding &rtdsBinding,
+    D3D12_RESOURCE_STATES                                inState,
+    D3D12_RESOURCE_FLAGS                                 rscFlags)
 {
-    RscUsageInfo info;
-    info.rscTempNodes.resize(rscs_.size());
+    return match_variant(rtdsBinding,
+        [](const FrameGraphPassNode::PassResource::RTB &rtb)
+    {
+        return !rtb.clear;
+    },
+        [](const FrameGraphPassNode::PassResource::DSB &dsb)
+    {
+        return !dsb.clearDepth || !dsb.clearStencil;
+    },
+        [&](const std::monostate &)
+    {
+        const bool isRTDS = (rscFlags & (
+            D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET |
+            D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)) != 0;
 
-    for(size_t i = 0; i < passes_.size(); ++i)
+        return (inState & (D3D12_RESOURCE_STATE_RENDER_TARGET |
+                           D3D12_RESOURCE_STATE_DEPTH_WRITE)) != 0 ||
+               (isRTDS && !(inState & D3D12_RESOURCE_STATE_COPY_DEST));
+    });
+}
+
+DXGI_FORMAT FrameGraphCompiler::getRscFormat(size_t rscIdx) const
+{
+    return match_variant(rscs_[rscIdx],
+        [](const CompilerInternalResourceNode &in)
     {
-        const PassIndex passIdx = { static_cast<int32_t>(i) };
-        auto &pass = passes_[i];
+        return in.desc.desc.Format;
+    },
+        [](const CompilerExternalResourceNode &en)
+    {
+        return en.rsc ? en.rsc->GetDesc().Format : DXGI_FORMAT_UNKNOWN;
+    });
+}
 
-        for(auto &rscUsage : pass.rscs)
-        {
-            auto &tempRsc = info.rscTempNodes[rscUsage.idx.idx];
+bool FrameGraphCompiler::isOverwritingUsage(
+    const CompilerPassNode::RscInPass &rscUsage,
+    DXGI_FORMAT                        rscFormat)
+{
+    if(rscUsage.inState & (D3D12_RESOURCE_STATE_COPY_DEST |
+                           D3D12_RESOURCE_STATE_RESOLVE_DEST))
+        return true;
 
-            const int idxInRscUsers = static_cast<int>(tempRsc.users.size());
-            rscUsage.idxInRscUsers = idxInRscUsers;
+    return match_variant(rscUsage.rtdsBinding,
+        [](const FrameGraphPassNode::PassResource::RTB &rtb)
+    {
+        return rtb.clear;
+    },
+        [&](const FrameGraphPassNode::PassResource::DSB &dsb)
+    {
+        DXGI_FORMAT format = rscUsage.viewDesc.as<_internalDSV>().desc.Format;
+        if(format == DXGI_FORMAT_UNKNOWN)
+            format = rscFormat;
 
-            tempRsc.users.push_back({ passIdx, rscUsage.inState });
+        return dsb.clearDepth && (dsb.clearStencil || !hasStencil(format));
+    },
+        [&](const std::monostate &)
+    {
+        auto uav = rscUsage.viewDesc.as_if<_internalUAV>();
+        return uav && uav->overwrite;
+    });
+}
 
-            match_variant(rscUsage.viewDesc,
-                [&](const _internalSRV &)  { ++info.gpuDescCount; },
-                [&](const _internalUAV &)  { ++info.gpuDescCount; },
-                [&](const _internalRTV &r) { ++info.rtvDescCount; },
-                [&](const _internalDSV &d) { ++info.dsvDescCount; },
-                [&](const std::monostate &) { });
+bool FrameGraphCompiler::isOverwrittenByFirstUser(
+    int32_t            track,
+    const TempRscNode &tempTrack) const
+{
+    const auto &firstUser = tempTrack.users.front();
+
+    for(auto &rscUsage : passes_[firstUser.first.idx].rscs)
+    {
+        const bool isTrackUser = std::any_of(
+            rscUsage.tracks.begin(), rscUsage.tracks.end(),
+            [&](const CompilerPassNode::RscInPass::TrackUsage &t)
+        {
+            return t.track == track;
+        });
+
+        if(isTrackUser)
+        {
+            return isOverwritingUsage(
+                rscUsage, getRscFormat(rscUsage.idx.idx));
         }
     }
 
-    return info;
+    return false;
+}
+
+D3D12_RESOURCE_STATES FrameGraphCompiler::getDiscardState(
+    D3D12_RESOURCE_STATES inState,
+    D3D12_RESOURCE_FLAGS  rscFlags) noexcept
+{
+    if(inState & (D3D12_RESOURCE_STATE_RENDER_TARGET |
+                  D3D12_RESOURCE_STATE_DEPTH_WRITE |
+                  D3D12_RESOURCE_STATE_UNORDERED_ACCESS))
+        return inState;
+
+    if(rscFlags & D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET)
+        return D3D12_RESOURCE_STATE_RENDER_TARGET;
+    if(rscFlags & D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL)
+        return D3D12_RESOURCE_STATE_DEPTH_WRITE;
+
+    return inState;
+}
+
+void FrameGraphCompiler::updateBeginAccess(
+    FrameGraphPassNode::PassResource &passRsc) noexcept
+{
+    auto getBeginAccess = [&](bool clear)
+    {
+        if(clear)
+            return D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_CLEAR;
+        if(passRsc.discard)
+            return D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_DISCARD;
+        return D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE;
+    };
+
+    match_variant(passRsc.rtdsBinding,
+        [&](FrameGraphPassNode::PassResource::RTB &rtb)
+    {
+        rtb.beginAccess = getBeginAccess(rtb.clear);
+    },
+        [&](FrameGraphPassNode::PassResource::DSB &dsb)
+    {
+        dsb.depthBeginAccess = getBeginAccess(dsb.clearDepth);
+
+        if(dsb.stencilBeginAccess !=
+            D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_NO_ACCESS)
+            dsb.stencilBeginAccess = getBeginAccess(dsb.clearStencil);
+    },
+        [&](const std::monostate &) { });
 }
 
 FrameGraphResourceNode FrameGraphCompiler::createD3DRscNode(
@@ -315,53 +2937,53 @@ FrameGraphResourceNode FrameGraphCompiler::createD3DRscNode(
         d3dRsc = en.rsc;
     });
 
-    return FrameGraphResourceNode(
-        cn.is<CompilerExternalResourceNode>(), d3dRsc);
+    auto en = cn.as_if<CompilerExternalResourceNode>();
+    return FrameGraphResourceNode(en && en->historyRing < 0, d3dRsc);
+}
+
+FrameGraphResourceNode FrameGraphCompiler::createPlacedD3DRscNode(
+    const CompilerInternalResourceNode &in,
+    D3D12MA::Allocation                *memory,
+    UINT64                              offset,
+    ResourceAllocator                  &rscAlloc,
+    ResourceReleaser                   &rscReleaser) const
+{
+    const auto clearValue = in.getClearValue();
+
+    auto d3dRsc = rscAlloc.allocPlacedResource(
+        memory, offset,
+        {
+            in.desc.desc,
+            clearValue.has_value(),
+            clearValue.has_value() ? *clearValue : D3D12_CLEAR_VALUE{}
+        },
+        in.initialState);
+
+    rscReleaser.add(d3dRsc);
+
+    return FrameGraphResourceNode(false, d3dRsc);
 }
 
 FrameGraphCompiler::PassRscStates FrameGraphCompiler::getPassRscStates(
-    const CompilerPassNode::RscInPass &rscUsage,
-    const CompilerResourceNode &rscNode,
-    const TempRscNode &tempNode) const
+    size_t             rscIdx,
+    const TempRscNode &trackTempNode,
+    int                idxInTrackUsers) const
 {
     PassRscStates ret = {};
 
-    const D3D12_RESOURCE_STATES rscInitState = match_variant(
-        rscs_[rscUsage.idx.idx],
-        [&](const CompilerExternalResourceNode &en)
-    {
-        return en.initialState;
-    },
-        [&](const CompilerInternalResourceNode &in)
-    {
-        return in.initialState;
-    });
+    const auto &users = trackTempNode.users;
 
-    if(rscUsage.idxInRscUsers > 0)
-    {
-        ret.beforeState =
-            tempNode.users[rscUsage.idxInRscUsers - 1].second;
-    }
+    if(idxInTrackUsers > 0)
+        ret.beforeState = users[idxInTrackUsers - 1].second;
     else
-        ret.beforeState = rscInitState;
+        ret.beforeState = getRscInitialState(rscIdx);
 
-    ret.inState = rscUsage.inState;
+    ret.inState = users[idxInTrackUsers].second;
 
-    if(rscUsage.idxInRscUsers + 1 ==
-        static_cast<int>(tempNode.users.size()))
-    {
-        match_variant(rscNode,
-            [&](const CompilerExternalResourceNode &en)
-        {
-            ret.afterState = en.finalState;
-        },
-            [&](const CompilerInternalResourceNode &)
-        {
-            ret.afterState = rscInitState;
-        });
-    }
+    if(idxInTrackUsers + 1 == static_cast<int>(users.size()))
+        ret.afterState = getRscFinalState(rscIdx);
     else
-        ret.afterState = rscUsage.inState;
+        ret.afterState = ret.inState;
 
     return ret;
 }
@@ -388,28 +3010,28 @@ void FrameGraphCompiler::inferDescFormat(
             fillFmt(view.desc.Format);
     },
         [&](_internalRTV &view) { fillFmt(view.desc.Format); },
-        [&](_internalDSV &view) { fillFmt(view.desc.Format); },
+        [&](_internalDSV &view)
+    {
+        fillFmt(view.desc.Format);
+
+        if((view.desc.Flags & D3D12_DSV_FLAG_READ_ONLY_DEPTH) &&
+           hasStencil(view.desc.Format))
+            view.desc.Flags |= D3D12_DSV_FLAG_READ_ONLY_STENCIL;
+    },
         [&](const std::monostate &) {});
 }
 
+std::string FrameGraphCompiler::getPassName(const CompilerPassNode &pass)
+{
+    if(!pass.name.empty())
+        return pass.name;
+    return "pass " + std::to_string(pass.index.idx);
+}
+
 FrameGraphPassNode::PassViewport FrameGraphCompiler::inferDefaultViewportAndScissor(
-    const CompilerPassNode::RscInPass::ViewDesc *view,
-    const std::vector<FrameGraphResourceNode> &rscNodes)
+    const D3D12_RESOURCE_DESC &rtdsDesc)
 {
     FrameGraphPassNode::PassViewport ret;
-    if(!view)
-        return ret;
-
-    const D3D12_RESOURCE_DESC rtdsDesc = match_variant(*view,
-        [&](const _internalRTV &rt)
-    {
-        return rscNodes[rt.rsc.idx].getD3DResource()->GetDesc();
-    },
-        [&](const _internalDSV &ds)
-    {
-        return rscNodes[ds.rsc.idx].getD3DResource()->GetDesc();
-    },
-        [](const auto &) { return D3D12_RESOURCE_DESC{}; });
 
     D3D12_VIEWPORT defaultVP;
     defaultVP.TopLeftX = 0;
@@ -432,36 +3054,154 @@ FrameGraphPassNode::PassViewport FrameGraphCompiler::inferDefaultViewportAndScis
 
 FrameGraphPassNode::PassResource FrameGraphCompiler::createFinalPassResource(
     CompilerPassNode::RscInPass                  &rscUsage,
-    const std::vector<TempRscNode>               &rscTempNodes,
+    size_t                                        trackIdx,
+    const RscUsageInfo                           &usageInfo,
+    const std::vector<TransientRscPlacement>     &rscPlacements,
     const std::vector<FrameGraphResourceNode>    &rscNodes,
-    DescriptorIndex                              &gpuDescIdx,
-    DescriptorIndex                              &rtvDescIdx,
-    DescriptorIndex                              &dsvDescIdx,
+    bool                                          persistentGPUDescs,
+    DescriptorIndices                            &frameDescIdx,
+    DescriptorIndices                            &graphDescIdx,
     const CompilerPassNode::RscInPass::ViewDesc *&rtdsView)
 {
     FrameGraphPassNode::PassResource passRsc;
     
-    passRsc.rscIdx = rscUsage.idx;
+    passRsc.rscIdx    = rscUsage.idx;
+    passRsc.trackOnly = trackIdx > 0;
     
-    // state transitions
+    // state transitions of the track
     
-    const auto &rscNode = rscs_[rscUsage.idx.idx];
-    const auto &tempRsc = rscTempNodes[rscUsage.idx.idx];
+    const auto &rscNode    = rscs_[rscUsage.idx.idx];
+    const auto &trackUsage = rscUsage.tracks[trackIdx];
+    const auto &tempRsc    = usageInfo.trackTempNodes[trackUsage.track];
+
+    const int k = trackUsage.idxInTrackUsers;
     
-    const auto states = getPassRscStates(
-        rscUsage, rscNode, tempRsc);
+    const auto states = getPassRscStates(rscUsage.idx.idx, tempRsc, k);
     
     passRsc.beforeState = states.beforeState;
     passRsc.inState     = states.inState;
     passRsc.afterState  = states.afterState;
+    passRsc.firstUse    = k == 0;
+
+    // transitions between queues may be recorded by the previous user
+
+    if(k > 0 && isTransitionHandedOff(tempRsc, k))
+        passRsc.beforeState = passRsc.inState;
+
+    if(k + 1 < static_cast<int>(tempRsc.users.size()) &&
+       isTransitionHandedOff(tempRsc, k + 1))
+        passRsc.afterState = tempRsc.users[k + 1].second;
+
+    // uav accesses without transitions are ordered by uav barriers.
+    // uavs of external rscs may be used right after the graph
+
+    const bool isUAV =
+        passRsc.inState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+
+    passRsc.uavBarrier =
+        isUAV && passRsc.beforeState == passRsc.inState &&
+        isUAVBarrierNeeded(tempRsc, k);
+
+    if(isUAV && passRsc.afterState == passRsc.inState &&
+       k + 1 == static_cast<int>(tempRsc.users.size()))
+    {
+        auto en = rscNode.as_if<CompilerExternalResourceNode>();
+        passRsc.outUAVBarrier = en && en->historyRing < 0;
+    }
+
+    // split transitions when other passes sit between producer and consumer
+
+    auto isSameQueue = [&](const PassIndex &a, const PassIndex &b)
+    {
+        return passes_[a.idx].queue == passes_[b.idx].queue;
+    };
+
+    if(k > 0)
+    {
+        const auto &prevUser = tempRsc.users[k - 1];
+        const auto &thisUser = tempRsc.users[k];
+
+        if(prevUser.second != thisUser.second &&
+           thisUser.first.idx > prevUser.first.idx + 1 &&
+           isSameQueue(prevUser.first, thisUser.first))
+            passRsc.splitBeginPass = prevUser.first.idx;
+    }
+
+    if(k + 1 < static_cast<int>(tempRsc.users.size()))
+    {
+        const auto &thisUser = tempRsc.users[k];
+        const auto &nextUser = tempRsc.users[k + 1];
+
+        if(nextUser.second != thisUser.second &&
+           nextUser.first.idx > thisUser.first.idx + 1 &&
+           isSameQueue(thisUser.first, nextUser.first))
+        {
+            passRsc.splitEndPass  = nextUser.first.idx;
+            passRsc.splitEndState = nextUser.second;
+        }
+    }
+
+    // activate aliased rsc in its first user. rt/ds must be initialized
+    // by clearing or discarding before each subresource is used
+
+    if(rscPlacements[rscUsage.idx.idx].aliased)
+    {
+        passRsc.aliasingBarrier =
+            rscUsage.idxInRscUsers == 0 && !passRsc.trackOnly;
+
+        if(passRsc.firstUse)
+        {
+            const auto rscFlags =
+                rscNodes[rscUsage.idx.idx].getD3DResource()->GetDesc().Flags;
+
+            passRsc.discard = isDiscardNeeded(
+                passRsc.trackOnly ?
+                    FrameGraphPassNode::PassResource::RTDSBinding() :
+                    rscUsage.rtdsBinding,
+                passRsc.inState, rscFlags);
+
+            if(passRsc.discard)
+            {
+                passRsc.discardState =
+                    getDiscardState(passRsc.inState, rscFlags);
+            }
+        }
+    }
+
+    // the view and binding belong to the first track
+
+    if(passRsc.trackOnly)
+        return passRsc;
     
     // assign descriptor
-    
+
+    const bool isExternal = rscNode.is<CompilerExternalResourceNode>();
+
     match_variant(rscUsage.viewDesc,
-        [&](const _internalSRV &) { passRsc.descIdx = gpuDescIdx++; },
-        [&](const _internalUAV &) { passRsc.descIdx = gpuDescIdx++; },
-        [&](const _internalRTV &) { passRsc.descIdx = rtvDescIdx++; },
-        [&](const _internalDSV &) { passRsc.descIdx = dsvDescIdx++; },
+        [&](const _internalSRV &)
+    {
+        passRsc.persistentDesc = persistentGPUDescs;
+        auto &idx = persistentGPUDescs ? graphDescIdx : frameDescIdx;
+        passRsc.descIdx = idx.gpu++;
+    },
+        [&](const _internalUAV &)
+    {
+        passRsc.persistentDesc = persistentGPUDescs;
+        auto &idx = persistentGPUDescs ? graphDescIdx : frameDescIdx;
+        passRsc.descIdx = idx.gpu++;
+    },
+        [&](const _internalRTV &)
+    {
+        passRsc.persistentDesc = !isExternal;
+        auto &idx = isExternal ? frameDescIdx : graphDescIdx;
+        passRsc.descIdx = idx.rtv++;
+    },
+        [&](const _internalDSV &)
+    {
+        passRsc.persistentDesc = !isExternal;
+        auto &idx = isExternal ? frameDescIdx : graphDescIdx;
+        passRsc.descIdx = idx.dsv++;
+    },
         [&](const std::monostate &) { });
     
     // render target / depth stencil binding
@@ -480,6 +3220,48 @@ FrameGraphPassNode::PassResource FrameGraphCompiler::createFinalPassResource(
 
     passRsc.viewDesc = rscUsage.viewDesc;
 
+    // render pass access. contents of the rsc are undefined before an
+    // aliasing activation, and unused after the last user of an internal
+    // rsc, unless the next frame uses them before overwriting them
+
+    const bool isLastUser =
+        k + 1 == static_cast<int>(tempRsc.users.size());
+    const bool isCarried =
+        !isOverwrittenByFirstUser(trackUsage.track, tempRsc);
+    const auto endAccess = !isExternal && !isCarried && isLastUser ?
+        D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_DISCARD :
+        D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
+
+    match_variant(passRsc.rtdsBinding,
+        [&](FrameGraphPassNode::PassResource::RTB &rtb)
+    {
+        rtb.passEndAccess = endAccess;
+        rtb.endAccess     = rtb.passEndAccess;
+    },
+        [&](FrameGraphPassNode::PassResource::DSB &dsb)
+    {
+        dsb.depthPassEndAccess = dsb.readOnly ?
+            D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE : endAccess;
+
+        if(hasStencil(rscUsage.viewDesc.as<_internalDSV>().desc.Format))
+        {
+            dsb.stencilPassEndAccess = dsb.depthPassEndAccess;
+        }
+        else
+        {
+            dsb.stencilBeginAccess =
+                D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_NO_ACCESS;
+            dsb.stencilPassEndAccess =
+                D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_NO_ACCESS;
+        }
+
+        dsb.depthEndAccess   = dsb.depthPassEndAccess;
+        dsb.stencilEndAccess = dsb.stencilPassEndAccess;
+    },
+        [&](const std::monostate &) { });
+
+    updateBeginAccess(passRsc);
+
     return passRsc;
 }
 
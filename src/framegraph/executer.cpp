@@ -1,3 +1,5 @@
+#include <chrono>
+
 #include <agz/d3d12/framegraph/executer.h>
 
 AGZ_D3D12_FG_BEGIN
@@ -7,7 +9,12 @@ FrameGraphExecuter::FrameGraphExecuter(
     : device_(device),
       threadCount_(threadCount),
       threadGroup_(threadCount),
-      cmdListPool_(device, threadCount, frameCount)
+      cmdListPool_(device, threadCount, frameCount),
+      scheduler_(device, cmdListPool_),
+      profiler_(device, frameCount),
+      threadStateFilterStats_(threadCount),
+      threadSplitBarrierCounts_(threadCount),
+      splitBarrierCount_(0)
 {
     
 }
@@ -15,18 +22,74 @@ FrameGraphExecuter::FrameGraphExecuter(
 void FrameGraphExecuter::startFrame(int frameIndex)
 {
     cmdListPool_.startFrame(frameIndex);
+    profiler_.startFrame(frameIndex);
+}
+
+void FrameGraphExecuter::setTaskBatchingOptions(
+    const FrameGraphTaskBatchingOptions &options)
+{
+    scheduler_.setBatchingOptions(options);
+}
+
+void FrameGraphExecuter::setProfilingOptions(
+    const FrameGraphProfilingOptions &options)
+{
+    profiler_.setOptions(options);
+}
+
+const FrameGraphProfiler &FrameGraphExecuter::getProfiler() const noexcept
+{
+    return profiler_;
+}
+
+const FrameGraphStateFilterStatistics &
+    FrameGraphExecuter::getStateFilterStatistics() const noexcept
+{
+    return stateFilterStats_;
+}
+
+size_t FrameGraphExecuter::getSplitBarrierCount() const noexcept
+{
+    return splitBarrierCount_;
 }
 
 void FrameGraphExecuter::execute(
-    ID3D12DescriptorHeap *gpuRawHeap,
-    FrameGraphData       &graph,
-    DescriptorRange       allGPUDescs,
-    DescriptorRange       allRTVDescs,
-    DescriptorRange       allDSVDescs,
-    ID3D12CommandQueue   *cmdQueue)
+    ID3D12DescriptorHeap      *gpuRawHeap,
+    FrameGraphData            &graph,
+    DescriptorRange            allGPUDescs,
+    DescriptorRange            allRTVDescs,
+    DescriptorRange            allDSVDescs,
+    const FrameGraphCmdQueues &cmdQueues)
 {
-    FrameGraphTaskScheduler scheduler(
-        graph.passNodes, cmdListPool_, cmdQueue);
+    scheduler_.restart(graph, cmdQueues, threadCount_);
+
+    const bool measurePassCost =
+        scheduler_.getBatchingOptions().measurePassCost;
+    const bool lockFree =
+        scheduler_.getBatchingOptions().lockFreeSubmission;
+    const bool filterStates =
+        scheduler_.getBatchingOptions().filterRedundantStates;
+
+    for(auto &s : threadStateFilterStats_)
+        s = {};
+    for(auto &c : threadSplitBarrierCounts_)
+        c = 0;
+
+    const bool profiling = profiler_.getOptions().enabled;
+    if(profiling)
+        profiler_.beginExecution(graph, cmdQueues);
+
+    // descs read by all chunks of a pass are created before recording
+
+    for(auto &passNode : graph.passNodes)
+    {
+        if(passNode.getPassData().chunkCount > 1)
+        {
+            passNode.createChunkDescriptors(
+                device_, graph.rscNodes,
+                allGPUDescs, allRTVDescs, allDSVDescs);
+        }
+    }
 
     threadGroup_.run(
         threadCount_,
@@ -36,34 +99,93 @@ void FrameGraphExecuter::execute(
         {
             FrameGraphTaskScheduler::TaskRange task;
 
+            if(lockFree)
+                task = scheduler_.requestTask();
+            else
             {
                 std::lock_guard lk(schedulerMutex_);
-                task = scheduler.requestTask();
+                task = scheduler_.requestTask();
             }
 
             if(!task.begNode)
                 return;
 
-            auto cmdList = cmdListPool_.requireGraphicsCommandList(threadIndex);
-            if(gpuRawHeap)
+            auto cmdList = cmdListPool_.requireCommandList(
+                threadIndex, task.queue);
+            if(gpuRawHeap && task.queue != FrameGraphQueue::Copy)
                 cmdList->SetDescriptorHeaps(1, &gpuRawHeap);
 
+            // bound states are tracked from the start of the cmd list
+
+            FrameGraphCmdListStates cmdListStates;
+            cmdListStates.filter = filterStates;
+
+            const FrameGraphPassRange cmdListPasses = {
+                static_cast<size_t>(task.begNode - graph.passNodes.data()),
+                static_cast<size_t>(task.endNode - graph.passNodes.data())
+            };
+
             for(auto n = task.begNode; n != task.endNode; ++n)
             {
+                const auto passIdx =
+                    static_cast<size_t>(n - graph.passNodes.data());
+
+                const auto start = std::chrono::steady_clock::now();
+
+                // a chunked pass is measured from its first chunk to
+                // its last one
+
+                if(profiling && task.chunk.isFirst())
+                    profiler_.beginPass(passIdx, threadIndex, cmdList.Get());
+
                 n->execute(
                     device_, graph.rscNodes,
                     allGPUDescs, allRTVDescs, allDSVDescs,
-                    cmdList.Get());
+                    passIdx, cmdListPasses, task.chunk,
+                    cmdListStates, cmdList.Get());
+
+                if(profiling && task.chunk.isLast())
+                    profiler_.endPass(passIdx, cmdList.Get());
+
+                // the first chunk is taken as a sample of all chunks
+
+                if(measurePassCost && task.chunk.isFirst())
+                {
+                    const auto end = std::chrono::steady_clock::now();
+                    scheduler_.reportPassCost(
+                        passIdx, task.chunk.count *
+                            std::chrono::duration<float, std::micro>(
+                                end - start).count());
+                }
             }
 
             cmdList->Close();
 
+            threadStateFilterStats_[threadIndex] += cmdListStates.filtered;
+            threadSplitBarrierCounts_[threadIndex] += cmdListStates.splitBarriers;
+
+            if(lockFree)
+                scheduler_.submitTask(task, std::move(cmdList));
+            else
             {
                 std::lock_guard lk(schedulerMutex_);
-                scheduler.submitTask(task, cmdList);
+                scheduler_.submitTask(task, std::move(cmdList));
             }
         }
     });
+
+    scheduler_.joinQueues();
+
+    stateFilterStats_ = {};
+    for(auto &s : threadStateFilterStats_)
+        stateFilterStats_ += s;
+
+    splitBarrierCount_ = 0;
+    for(auto c : threadSplitBarrierCounts_)
+        splitBarrierCount_ += c;
+
+    if(profiling)
+        profiler_.endExecution(cmdListPool_);
 }
 
 AGZ_D3D12_FG_END
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <agz/d3d12/framegraph/framegraph.h>
 
 AGZ_D3D12_FG_BEGIN
@@ -13,19 +15,42 @@ FrameGraph::FrameGraph(
     int                 frameCount)
     : device_       (device),
       cmdQueue_     (cmdQueue),
+      computeQueue_ (nullptr),
+      copyQueue_    (nullptr),
       subRTVHeap_   (std::move(subRTVHeap)),
       subDSVHeap_   (std::move(subDSVHeap)),
       subGPUHeap_   (std::move(subGPUHeap)),
       rscAllocator_ (device, adaptor),
       graphReleaser_(device),
       frameReleaser_(device),
-      executer_     (device, threadCount, frameCount)
+      executer_     (device, threadCount, frameCount),
+      backbufferWidth_ (0),
+      backbufferHeight_(0),
+      graphCacheCapacity_(1),
+      graphCacheHitCount_(0),
+      graphCacheMissCount_(0),
+      graphData_(nullptr),
+      frameDescRanges_(frameCount),
+      frameIndex_(0)
 {
 
 }
 
 FrameGraph::~FrameGraph()
 {
+    for(auto &g : graphCache_)
+        retireCompiledGraph(g);
+
+    for(auto &r : frameDescRanges_)
+    {
+        if(r.rtv.getCount())
+            frameReleaser_.add(subRTVHeap_, r.rtv);
+        if(r.dsv.getCount())
+            frameReleaser_.add(subDSVHeap_, r.dsv);
+        if(r.gpu.getCount())
+            frameReleaser_.add(subGPUHeap_, r.gpu);
+    }
+
     graphReleaser_.addReleasePoint(cmdQueue_);
     frameReleaser_.addReleasePoint(cmdQueue_);
 }
@@ -33,6 +58,7 @@ FrameGraph::~FrameGraph()
 void FrameGraph::startFrame(int frameIndex)
 {
     executer_.startFrame(frameIndex);
+    frameIndex_ = frameIndex;
     graphReleaser_.collect();
     frameReleaser_.collect();
 }
@@ -47,52 +73,351 @@ void FrameGraph::newGraph()
     compiler_ = std::make_unique<FrameGraphCompiler>();
 }
 
+PassIndex FrameGraph::addResolvePass(
+    ResourceIndex src,
+    ResourceIndex dst,
+    PassName      name,
+    DXGI_FORMAT   format)
+{
+    return compiler_->addResolvePass(src, dst, std::move(name), format);
+}
+
 void FrameGraph::reset()
 {
     graphReleaser_.addReleasePoint(cmdQueue_);
 
     compiler_.reset();
-    graphData_ = {};
+    graphData_ = nullptr;
+
+    // kept graphs must not hold external rscs (e.g. swap chain images)
+
+    clearExternalResources();
+}
+
+void FrameGraph::setCompileOptions(const FrameGraphCompileOptions &options)
+{
+    compileOptions_ = options;
+}
+
+void FrameGraph::setTaskBatchingOptions(
+    const FrameGraphTaskBatchingOptions &options)
+{
+    executer_.setTaskBatchingOptions(options);
+}
+
+void FrameGraph::setProfilingOptions(const FrameGraphProfilingOptions &options)
+{
+    executer_.setProfilingOptions(options);
+}
+
+std::vector<FrameGraphPassProfile> FrameGraph::getPassProfiles() const
+{
+    return executer_.getProfiler().getPassProfiles();
+}
+
+std::string FrameGraph::exportChromeTrace() const
+{
+    return executer_.getProfiler().exportChromeTrace();
+}
+
+void FrameGraph::setAsyncComputeQueue(ID3D12CommandQueue *computeQueue)
+{
+    computeQueue_ = computeQueue;
+}
+
+void FrameGraph::setCopyQueue(ID3D12CommandQueue *copyQueue)
+{
+    copyQueue_ = copyQueue;
+}
+
+void FrameGraph::setGraphCacheCapacity(size_t capacity)
+{
+    graphCacheCapacity_ = (std::max<size_t>)(capacity, 1);
+
+    while(graphCache_.size() > graphCacheCapacity_)
+    {
+        retireCompiledGraph(graphCache_.back());
+        graphCache_.pop_back();
+    }
+}
+
+void FrameGraph::setResourcePoolCapacity(UINT64 byteSize)
+{
+    rscAllocator_.setPoolCapacity(byteSize);
 }
 
 void FrameGraph::compile()
 {
+    auto options = compileOptions_;
+    options.asyncCompute &= computeQueue_ != nullptr;
+    options.copyQueue    &= copyQueue_ != nullptr;
+
+    std::string structureKey = compiler_->getStructureKey(options);
+    const size_t structureHash = std::hash<std::string>{}(structureKey);
+
+    // reuse kept graph
+
+    for(auto it = graphCache_.begin(); it != graphCache_.end(); ++it)
+    {
+        if(it->structureHash != structureHash ||
+           it->structureKey  != structureKey)
+            continue;
+
+        graphCache_.splice(graphCache_.begin(), graphCache_, it);
+        graphData_ = &graphCache_.front().data;
+
+        resizeCompiledGraph(graphCache_.front());
+        compiler_->rebindCompiledGraph(*graphData_);
+        recordBundles(*graphData_);
+
+        ++graphCacheHitCount_;
+        return;
+    }
+
+    // compile new graph
+
+    auto rscReleaser         = std::make_unique<ResourceReleaser>(device_);
+    auto relativeRscReleaser = std::make_unique<ResourceReleaser>(device_);
+
+    compiler_->setBackbufferSize(backbufferWidth_, backbufferHeight_);
+    auto data = compiler_->compile(
+        rscAllocator_, *rscReleaser, *relativeRscReleaser, options);
+
+    // create descs of internal rscs once
+
+    createPersistentDescriptors(data, *relativeRscReleaser);
+    recordBundles(data);
+
+    graphCache_.push_front({
+        structureHash, std::move(structureKey),
+        std::move(rscReleaser), std::move(relativeRscReleaser),
+        std::move(data) });
+    graphData_ = &graphCache_.front().data;
+
+    ++graphCacheMissCount_;
+
+    // evict least recently used graphs
+
+    while(graphCache_.size() > graphCacheCapacity_)
+    {
+        retireCompiledGraph(graphCache_.back());
+        graphCache_.pop_back();
+    }
+
     graphReleaser_.addReleasePoint(cmdQueue_);
-    graphData_ = compiler_->compile(rscAllocator_, graphReleaser_);
+}
+
+const FrameGraphCompileStatistics &
+    FrameGraph::getCompileStatistics() const noexcept
+{
+    return graphData_->statistics;
+}
+
+FrameGraphReport FrameGraph::getReport() const
+{
+    return createFrameGraphReport(device_, *graphData_);
+}
+
+size_t FrameGraph::getGraphCacheHitCount() const noexcept
+{
+    return graphCacheHitCount_;
+}
+
+size_t FrameGraph::getGraphCacheMissCount() const noexcept
+{
+    return graphCacheMissCount_;
+}
+
+const ResourcePoolStatistics &
+    FrameGraph::getResourcePoolStatistics() const noexcept
+{
+    return rscAllocator_.getPoolStatistics();
+}
+
+const FrameGraphStateFilterStatistics &
+    FrameGraph::getStateFilterStatistics() const noexcept
+{
+    return executer_.getStateFilterStatistics();
+}
+
+size_t FrameGraph::getSplitBarrierCount() const noexcept
+{
+    return executer_.getSplitBarrierCount();
 }
 
 void FrameGraph::setExternalRsc(
     ResourceIndex idx, ComPtr<ID3D12Resource> rsc)
 {
-    graphData_.rscNodes[idx.idx].setExternalResource(std::move(rsc));
+    graphData_->rscNodes[idx.idx].setExternalResource(std::move(rsc));
+    FrameGraphCompiler::updateInferredViewports(*graphData_, idx);
+}
+
+void FrameGraph::clearExternalResources()
+{
+    if(compiler_)
+        compiler_->clearExternalResources();
+
+    for(auto &g : graphCache_)
+    {
+        for(auto &rscNode : g.data.rscNodes)
+        {
+            if(rscNode.isExternal())
+                rscNode.setExternalResource(nullptr);
+        }
+    }
+}
+
+void FrameGraph::resize(UINT width, UINT height)
+{
+    backbufferWidth_  = width;
+    backbufferHeight_ = height;
+
+    if(compiler_)
+        compiler_->setBackbufferSize(width, height);
+
+    if(graphData_)
+    {
+        resizeCompiledGraph(graphCache_.front());
+        recordBundles(*graphData_);
+    }
 }
 
 void FrameGraph::execute()
 {
-    DescriptorRange rtvRange;
-    if(graphData_.rtvDescCount)
+    // per-frame descs are reused by frames of the same index, as the gpu
+    // has finished using them when the frame starts
+
+    auto requireRange = [&](
+        DescriptorSubHeap &subheap, DescriptorRange &range,
+        DescriptorCount count)
     {
-        rtvRange = subRTVHeap_.allocRange(graphData_.rtvDescCount);
-        frameReleaser_.add(subRTVHeap_, rtvRange);
+        if(!count)
+            return DescriptorRange();
+
+        if(range.getCount() < count)
+        {
+            if(range.getCount())
+                frameReleaser_.add(subheap, range);
+            range = subheap.allocRange(count);
+        }
+
+        return range.getSubRange(0, count);
+    };
+
+    auto &frameRanges = frameDescRanges_[frameIndex_];
+
+    const DescriptorRange rtvRange = requireRange(
+        subRTVHeap_, frameRanges.rtv, graphData_->rtvDescCount);
+    const DescriptorRange dsvRange = requireRange(
+        subDSVHeap_, frameRanges.dsv, graphData_->dsvDescCount);
+    const DescriptorRange gpuRange = requireRange(
+        subGPUHeap_, frameRanges.gpu, graphData_->gpuDescCount);
+
+    executer_.execute(
+        subGPUHeap_.getRawHeap(), *graphData_,
+        gpuRange, rtvRange, dsvRange, { cmdQueue_, computeQueue_, copyQueue_ });
+
+    FrameGraphCompiler::rotateHistoryRings(*graphData_);
+}
+
+void FrameGraph::retireCompiledGraph(CompiledGraph &graph)
+{
+    // rscs & bundles of the graph may still be used by gpu
+
+    for(auto &passNode : graph.data.passNodes)
+        passNode.releaseBundle(graphReleaser_);
+
+    graph.data = {};
+    graphReleaser_.takeRecordsFrom(*graph.rscReleaser);
+    graphReleaser_.takeRecordsFrom(*graph.relativeRscReleaser);
+}
+
+void FrameGraph::createPersistentDescriptors(
+    FrameGraphData &data, ResourceReleaser &rscReleaser)
+{
+    DescriptorRange graphRTVRange;
+    if(data.graphRTVDescCount)
+    {
+        graphRTVRange = subRTVHeap_.allocRange(data.graphRTVDescCount);
+        rscReleaser.add(subRTVHeap_, graphRTVRange);
     }
 
-    DescriptorRange dsvRange;
-    if(graphData_.dsvDescCount)
+    DescriptorRange graphDSVRange;
+    if(data.graphDSVDescCount)
     {
-        dsvRange = subDSVHeap_.allocRange(graphData_.dsvDescCount);
-        frameReleaser_.add(subDSVHeap_, dsvRange);
+        graphDSVRange = subDSVHeap_.allocRange(data.graphDSVDescCount);
+        rscReleaser.add(subDSVHeap_, graphDSVRange);
     }
 
-    DescriptorRange gpuRange;
-    if(graphData_.gpuDescCount)
+    DescriptorRange graphGPURange;
+    if(data.graphGPUDescCount)
     {
-        gpuRange = subGPUHeap_.allocRange(graphData_.gpuDescCount);
-        frameReleaser_.add(subGPUHeap_, gpuRange);
+        graphGPURange = subGPUHeap_.allocRange(data.graphGPUDescCount);
+        rscReleaser.add(subGPUHeap_, graphGPURange);
     }
 
-    executer_.execute(
-        subGPUHeap_.getRawHeap(), graphData_,
-        gpuRange, rtvRange, dsvRange, cmdQueue_);
+    for(auto &passNode : data.passNodes)
+    {
+        passNode.createPersistentDescriptors(
+            device_, data.rscNodes,
+            graphGPURange, graphRTVRange, graphDSVRange);
+    }
+}
+
+void FrameGraph::resizeCompiledGraph(CompiledGraph &graph)
+{
+    auto &data = graph.data;
+
+    if(data.backbufferWidth  == backbufferWidth_ &&
+       data.backbufferHeight == backbufferHeight_)
+        return;
+
+    const bool hasRelativeHistoryRings = std::any_of(
+        data.historyRings.begin(), data.historyRings.end(),
+        [](const FrameGraphHistoryRing &ring)
+    {
+        return ring.relativeSize.has_value();
+    });
+
+    if(data.relativeRscs.empty() && !hasRelativeHistoryRings)
+    {
+        data.backbufferWidth  = backbufferWidth_;
+        data.backbufferHeight = backbufferHeight_;
+        return;
+    }
+
+    // old relative rscs & descs may still be used by gpu
+
+    graphReleaser_.takeRecordsFrom(*graph.relativeRscReleaser);
+    graphReleaser_.addReleasePoint(cmdQueue_);
+
+    FrameGraphCompiler::resizeCompiledGraph(
+        data, backbufferWidth_, backbufferHeight_,
+        rscAllocator_, *graph.relativeRscReleaser);
+
+    // descs of a pass are contiguous, so all of them are recreated
+
+    createPersistentDescriptors(data, *graph.relativeRscReleaser);
+}
+
+void FrameGraph::recordBundles(FrameGraphData &data)
+{
+    // bundles replaced by new ones may still be used by gpu
+
+    bool recorded = false;
+    for(auto &passNode : data.passNodes)
+    {
+        if(passNode.isBundleOutdated())
+        {
+            passNode.recordBundle(
+                device_, subGPUHeap_.getRawHeap(),
+                data.rscNodes, graphReleaser_);
+            recorded = true;
+        }
+    }
+
+    if(recorded)
+        graphReleaser_.addReleasePoint(cmdQueue_);
 }
 
 ResourceIndex FrameGraph::addInternalResource(
@@ -147,6 +472,12 @@ ResourceIndex FrameGraph::addInternalResource(
         clearDepthStencilValue, clearFormat);
 }
 
+HistoryResourceIndex FrameGraph::addHistoryResource(
+    const RscDesc &rscDesc, int32_t historyLength)
+{
+    return compiler_->addHistoryResource(rscDesc, historyLength);
+}
+
 ResourceIndex FrameGraph::addExternalResource(
     const ComPtr<ID3D12Resource> rscDesc,
     D3D12_RESOURCE_STATES        initialState,
@@ -1,8 +1,32 @@
+#include <algorithm>
+#include <cstring>
+
 #include <agz/d3d12/framegraph/graphData.h>
 #include <agz/d3d12/framegraph/passContext.h>
 
 AGZ_D3D12_FG_BEGIN
 
+FrameGraphStateFilterStatistics &FrameGraphStateFilterStatistics::operator+=(
+    const FrameGraphStateFilterStatistics &rhs) noexcept
+{
+    pipelineStates += rhs.pipelineStates;
+    rootSignatures += rhs.rootSignatures;
+    renderTargets  += rhs.renderTargets;
+    viewports      += rhs.viewports;
+    scissors       += rhs.scissors;
+    return *this;
+}
+
+void FrameGraphCmdListStates::invalidate() noexcept
+{
+    pipelineState         = nullptr;
+    graphicsRootSignature = nullptr;
+    computeRootSignature  = nullptr;
+    renderTargetsBound    = false;
+    viewports             = nullptr;
+    scissors              = nullptr;
+}
+
 FrameGraphResourceNode::FrameGraphResourceNode(
     bool isExternal, ComPtr<ID3D12Resource> d3dRsc)
     : isExternal_(isExternal), d3dRsc_(d3dRsc)
@@ -17,19 +41,30 @@ void FrameGraphResourceNode::setExternalResource(
     d3dRsc_ = d3dRsc;
 }
 
+void FrameGraphResourceNode::setHistoryResource(ComPtr<ID3D12Resource> d3dRsc)
+{
+    assert(!isExternal_);
+    d3dRsc_ = std::move(d3dRsc);
+}
+
+bool FrameGraphResourceNode::isExternal() const noexcept
+{
+    return isExternal_;
+}
+
 ID3D12Resource *FrameGraphResourceNode::getD3DResource() const noexcept
 {
     return d3dRsc_.Get();
 }
 
 FrameGraphPassNode::FrameGraphPassNode(
-    std::map<ResourceIndex, PassResource> rscs,
-    PassViewport                          passViewport,
-    FrameGraphPassFunc                    passFunc,
-    ComPtr<ID3D12PipelineState>           pipelineState,
-    ComPtr<ID3D12RootSignature>           rootSignature) noexcept
+    PassData                    passData,
+    PassViewport                passViewport,
+    FrameGraphPassFunc          passFunc,
+    ComPtr<ID3D12PipelineState> pipelineState,
+    ComPtr<ID3D12RootSignature> rootSignature) noexcept
     : isGraphics_(true),
-      rscs_(std::move(rscs)),
+      data_(passData),
       viewport_(std::move(passViewport)),
       passFunc_(std::move(passFunc)),
       pipelineState_(std::move(pipelineState)),
@@ -39,12 +74,12 @@ FrameGraphPassNode::FrameGraphPassNode(
 }
 
 FrameGraphPassNode::FrameGraphPassNode(
-    std::map<ResourceIndex, PassResource> rscs,
-    FrameGraphPassFunc                    passFunc,
-    ComPtr<ID3D12PipelineState>           pipelineState,
-    ComPtr<ID3D12RootSignature>           rootSignature) noexcept
+    PassData                    passData,
+    FrameGraphPassFunc          passFunc,
+    ComPtr<ID3D12PipelineState> pipelineState,
+    ComPtr<ID3D12RootSignature> rootSignature) noexcept
     : isGraphics_(false),
-      rscs_(std::move(rscs)),
+      data_(passData),
       viewport_({}),
       passFunc_(std::move(passFunc)),
       pipelineState_(std::move(pipelineState)),
@@ -53,6 +88,204 @@ FrameGraphPassNode::FrameGraphPassNode(
     
 }
 
+void FrameGraphPassNode::createPersistentDescriptors(
+    ID3D12Device                              *device,
+    const std::vector<FrameGraphResourceNode> &rscNodes,
+    DescriptorRange                            graphGPUDescs,
+    DescriptorRange                            graphRTVDescs,
+    DescriptorRange                            graphDSVDescs)
+{
+    // the bundle refers to the old descriptors
+
+    bundleOutdated_ = true;
+
+    for(auto &r : data_.rscs)
+    {
+        if(!r.persistentDesc)
+            continue;
+
+        auto d3dRsc = rscNodes[r.rscIdx.idx].getD3DResource();
+
+        match_variant(r.viewDesc,
+            [&](const _internalSRV &srv)
+        {
+            r.descriptor = graphGPUDescs[r.descIdx];
+            device->CreateShaderResourceView(
+                d3dRsc, &srv.desc, r.descriptor);
+        },
+            [&](const _internalUAV &uav)
+        {
+            r.descriptor = graphGPUDescs[r.descIdx];
+            device->CreateUnorderedAccessView(
+                d3dRsc, nullptr, &uav.desc, r.descriptor);
+        },
+            [&](const _internalRTV &rtv)
+        {
+            r.descriptor = graphRTVDescs[r.descIdx];
+            device->CreateRenderTargetView(
+                d3dRsc, &rtv.desc, r.descriptor);
+        },
+            [&](const _internalDSV &dsv)
+        {
+            r.descriptor = graphDSVDescs[r.descIdx];
+            device->CreateDepthStencilView(
+                d3dRsc, &dsv.desc, r.descriptor);
+        },
+            [&](const std::monostate &) {});
+    }
+}
+
+void FrameGraphPassNode::rebind(
+    FrameGraphPassFunc          passFunc,
+    ComPtr<ID3D12PipelineState> pipelineState,
+    ComPtr<ID3D12RootSignature> rootSignature)
+{
+    // commands of static passes are assumed to be the same across frames,
+    // unless the states they are recorded with are changed
+
+    if(pipelineState != pipelineState_ || rootSignature != rootSignature_)
+        bundleOutdated_ = true;
+
+    passFunc_      = std::move(passFunc);
+    pipelineState_ = std::move(pipelineState);
+    rootSignature_ = std::move(rootSignature);
+}
+
+void FrameGraphPassNode::updateDefaultViewport(
+    const PassViewport &inferred, bool viewport, bool scissor)
+{
+    if(viewport)
+        viewport_.viewports = inferred.viewports;
+    if(scissor)
+        viewport_.scissors = inferred.scissors;
+}
+
+bool FrameGraphPassNode::isBundleOutdated() const noexcept
+{
+    return data_.bundle && bundleOutdated_;
+}
+
+void FrameGraphPassNode::recordBundle(
+    ID3D12Device                              *device,
+    ID3D12DescriptorHeap                      *gpuRawHeap,
+    const std::vector<FrameGraphResourceNode> &rscNodes,
+    ResourceReleaser                          &rscReleaser)
+{
+    assert(data_.bundle && isGraphics_);
+
+    releaseBundle(rscReleaser);
+
+    AGZ_D3D12_CHECK_HR(
+        device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_BUNDLE,
+            IID_PPV_ARGS(bundleAllocator_.GetAddressOf())));
+
+    AGZ_D3D12_CHECK_HR(
+        device->CreateCommandList(
+            0, D3D12_COMMAND_LIST_TYPE_BUNDLE,
+            bundleAllocator_.Get(), pipelineState_.Get(),
+            IID_PPV_ARGS(bundle_.GetAddressOf())));
+
+    // heaps of a bundle must match the executing cmd list
+
+    if(gpuRawHeap)
+        bundle_->SetDescriptorHeaps(1, &gpuRawHeap);
+
+    if(rootSignature_)
+        bundle_->SetGraphicsRootSignature(rootSignature_.Get());
+
+    // all gpu descs of static pass are persistent
+
+    FrameGraphPassContext passCtx(rscNodes, *this, {}, {}, {}, {});
+
+    assert(passFunc_);
+    passFunc_(bundle_.Get(), passCtx);
+
+    AGZ_D3D12_CHECK_HR(bundle_->Close());
+
+    bundleOutdated_ = false;
+}
+
+void FrameGraphPassNode::releaseBundle(ResourceReleaser &rscReleaser)
+{
+    if(bundle_)
+    {
+        rscReleaser.add(std::move(bundleAllocator_), std::move(bundle_));
+    }
+    bundleOutdated_ = true;
+}
+
+void FrameGraphPassNode::createChunkDescriptors(
+    ID3D12Device                              *device,
+    const std::vector<FrameGraphResourceNode> &rscNodes,
+    DescriptorRange                            allGPUDescs,
+    DescriptorRange                            allRTVDescs,
+    DescriptorRange                            allDSVDescs) const
+{
+    size_t renderTargetCount = 0;
+
+    for(auto &r : data_.rscs)
+    {
+        auto d3dRsc = rscNodes[r.rscIdx.idx].getD3DResource();
+
+        match_variant(r.viewDesc,
+            [&](const _internalSRV &srv)
+        {
+            if(r.persistentDesc)
+                return;
+            r.descriptor = allGPUDescs[r.descIdx];
+            device->CreateShaderResourceView(
+                d3dRsc, &srv.desc, r.descriptor);
+        },
+            [&](const _internalUAV &uav)
+        {
+            if(r.persistentDesc)
+                return;
+            r.descriptor = allGPUDescs[r.descIdx];
+            device->CreateUnorderedAccessView(
+                d3dRsc, nullptr, &uav.desc, r.descriptor);
+        },
+            [&](const _internalRTV &rtv)
+        {
+            if(!r.persistentDesc)
+            {
+                r.descriptor = allRTVDescs[r.descIdx];
+                device->CreateRenderTargetView(
+                    d3dRsc, &rtv.desc, r.descriptor);
+            }
+
+            if(r.rtdsBinding.is<PassResource::RTB>())
+                data_.rtvHandles[renderTargetCount++] = r.descriptor;
+        },
+            [&](const _internalDSV &dsv)
+        {
+            if(r.persistentDesc)
+                return;
+            r.descriptor = allDSVDescs[r.descIdx];
+            device->CreateDepthStencilView(
+                d3dRsc, &dsv.desc, r.descriptor);
+        },
+            [&](const std::monostate &) {});
+    }
+}
+
+void FrameGraphPassNode::setMergedPasses(
+    bool withPrev, bool withNext) noexcept
+{
+    data_.mergedWithPrev = withPrev;
+    data_.mergedWithNext = withNext;
+}
+
+bool FrameGraphPassNode::isGraphics() const noexcept
+{
+    return isGraphics_;
+}
+
+const FrameGraphPassNode::PassData &FrameGraphPassNode::getPassData() const noexcept
+{
+    return data_;
+}
+
 template<bool IS_GRAPHICS>
 bool FrameGraphPassNode::executeImpl(
     ID3D12Device                        *device,
@@ -60,82 +293,261 @@ bool FrameGraphPassNode::executeImpl(
     DescriptorRange                      allGPUDescs,
     DescriptorRange                      allRTVDescs,
     DescriptorRange                      allDSVDescs,
+    size_t                               passIdx,
+    FrameGraphPassRange                  cmdListPasses,
+    FrameGraphPassChunk                  chunk,
+    FrameGraphCmdListStates             &cmdListStates,
     ID3D12GraphicsCommandList           *cmdList) const
 {
-    // rsc barriers & descs
+    // rsc barriers & descs.
+    // in barriers are recorded by the first chunk, out ones by the last
+
+    auto &barriers = data_.barriers;
+    size_t inBarrierCount = 0, outBarrierCount = 0;
 
-    std::vector<D3D12_RESOURCE_BARRIER> inBarriers, outBarriers;
-    inBarriers.reserve(rscs_.size());
-    outBarriers.reserve(rscs_.size());
+    auto addInBarrier = [&](const D3D12_RESOURCE_BARRIER &barrier)
+    {
+        assert(inBarrierCount + outBarrierCount < barriers.size);
+        if(chunk.isFirst())
+            barriers[inBarrierCount++] = barrier;
+    };
 
-    for(auto &p : rscs_)
+    auto addOutBarrier = [&](const D3D12_RESOURCE_BARRIER &barrier)
+    {
+        assert(inBarrierCount + outBarrierCount < barriers.size);
+        if(chunk.isLast())
+            barriers[barriers.size - ++outBarrierCount] = barrier;
+    };
+
+    // states of a pass rsc apply to all subresources at once,
+    // or to each of its subresources
+
+    auto forEachSubresource = [](const PassResource &r, const auto &func)
+    {
+        if(!r.subresources.size)
+        {
+            func(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES);
+            return;
+        }
+
+        for(UINT subrsc : r.subresources)
+            func(subrsc);
+    };
+
+    for(auto &r : data_.rscs)
     {
-        auto &r     = p.second;
         auto d3dRsc = rscNodes[r.rscIdx.idx].getD3DResource();
 
-        if(r.beforeState != r.inState)
+        if(r.aliasingBarrier)
+        {
+            addInBarrier(CD3DX12_RESOURCE_BARRIER::Aliasing(
+                nullptr, d3dRsc));
+        }
+
+        // rscs discarded in another state enter inState after discarding
+
+        const auto enteredState = r.discard && r.discardState != r.inState ?
+                                  r.discardState : r.inState;
+
+        if(r.beforeState != enteredState)
         {
-            inBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(
-                d3dRsc, r.beforeState, r.inState));
+            const bool isSplit =
+                enteredState == r.inState &&
+                r.splitBeginPass >= 0 &&
+                cmdListPasses.contains(r.splitBeginPass);
+
+            forEachSubresource(r, [&](UINT subrsc)
+            {
+                addInBarrier(CD3DX12_RESOURCE_BARRIER::Transition(
+                    d3dRsc, r.beforeState, enteredState, subrsc,
+                    isSplit ? D3D12_RESOURCE_BARRIER_FLAG_END_ONLY :
+                              D3D12_RESOURCE_BARRIER_FLAG_NONE));
+            });
         }
-        else if(r.beforeState == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
-            inBarriers.push_back(CD3DX12_RESOURCE_BARRIER::UAV(d3dRsc));
+
+        if(r.uavBarrier)
+            addInBarrier(CD3DX12_RESOURCE_BARRIER::UAV(d3dRsc));
 
         if(r.inState != r.afterState)
         {
-            outBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(
-                d3dRsc, r.inState, r.afterState));
+            forEachSubresource(r, [&](UINT subrsc)
+            {
+                addOutBarrier(CD3DX12_RESOURCE_BARRIER::Transition(
+                    d3dRsc, r.inState, r.afterState, subrsc));
+            });
+        }
+        else if(r.splitEndPass >= 0 && cmdListPasses.contains(r.splitEndPass))
+        {
+            if(chunk.isLast())
+                ++cmdListStates.splitBarriers;
+
+            forEachSubresource(r, [&](UINT subrsc)
+            {
+                addOutBarrier(CD3DX12_RESOURCE_BARRIER::Transition(
+                    d3dRsc, r.inState, r.splitEndState, subrsc,
+                    D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY));
+            });
         }
 
-        // IMPROVE: out UAV barrier is omitted, which may cause problems
-        // if user uses it through uav after the fg execution
+        if(r.outUAVBarrier)
+            addOutBarrier(CD3DX12_RESOURCE_BARRIER::UAV(d3dRsc));
     }
 
-    if(!inBarriers.empty())
+    if(inBarrierCount)
     {
         cmdList->ResourceBarrier(
-            static_cast<UINT>(inBarriers.size()), inBarriers.data());
+            static_cast<UINT>(inBarrierCount), barriers.data);
     }
 
-    // create descriptors
+    // activated aliased rsc must be initialized before being used
+
+    size_t discardBarrierCount = 0;
+
+    for(auto &r : data_.rscs)
+    {
+        if(!r.discard || !chunk.isFirst())
+            continue;
+
+        auto d3dRsc = rscNodes[r.rscIdx.idx].getD3DResource();
+        if(!r.subresources.size)
+            cmdList->DiscardResource(d3dRsc, nullptr);
+        else
+        {
+            for(UINT subrsc : r.subresources)
+            {
+                const D3D12_DISCARD_REGION region = { 0, nullptr, subrsc, 1 };
+                cmdList->DiscardResource(d3dRsc, &region);
+            }
+        }
+
+        if(r.discardState == r.inState)
+            continue;
 
-    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> renderTargetHandles;
+        forEachSubresource(r, [&](UINT subrsc)
+        {
+            assert(discardBarrierCount + outBarrierCount < barriers.size);
+            barriers[discardBarrierCount++] =
+                CD3DX12_RESOURCE_BARRIER::Transition(
+                    d3dRsc, r.discardState, r.inState, subrsc);
+        });
+    }
+
+    if(discardBarrierCount)
+    {
+        cmdList->ResourceBarrier(
+            static_cast<UINT>(discardBarrierCount), barriers.data);
+    }
+
+    // render pass. clears are done by its beginning accesses
+
+    ComPtr<ID3D12GraphicsCommandList4> renderPassCmdList;
+    if constexpr(IS_GRAPHICS)
+    {
+        if(data_.renderPass)
+        {
+            cmdList->QueryInterface(
+                IID_PPV_ARGS(renderPassCmdList.GetAddressOf()));
+        }
+    }
+
+    D3D12_RENDER_PASS_RENDER_TARGET_DESC
+        renderPassRTs[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+    D3D12_RENDER_PASS_DEPTH_STENCIL_DESC renderPassDS;
+    D3D12_RENDER_PASS_FLAGS renderPassFlags = D3D12_RENDER_PASS_FLAG_NONE;
+
+    // a render pass split into chunks is suspended at the end of each chunk
+    // and resumed by the next one. only the outermost accesses are kept
+
+    auto getChunkBeginAccess = [&](D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE t)
+    {
+        return chunk.isFirst() ?
+            t : D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE;
+    };
+
+    auto getChunkEndAccess = [&](D3D12_RENDER_PASS_ENDING_ACCESS_TYPE t)
+    {
+        return chunk.isLast() ?
+            t : D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
+    };
+
+    // create descriptors of external rscs.
+    // those of chunked passes are created before recording
+
+    const bool createDescs = chunk.count == 1;
+
+    size_t renderTargetCount = 0;
     std::optional<D3D12_CPU_DESCRIPTOR_HANDLE> depthStencilHandle;
 
     D3D12_RESOURCE_DESC firstRTVOrDSVDesc;
     firstRTVOrDSVDesc.Width = 0;
 
-    for(auto &p : rscs_)
+    for(auto &r : data_.rscs)
     {
-        auto &r = p.second;
         auto d3dRsc = rscNodes[r.rscIdx.idx].getD3DResource();
         
         match_variant(r.viewDesc,
             [&](const _internalSRV &srv)
         {
+            if(r.persistentDesc || !createDescs)
+                return;
             r.descriptor = allGPUDescs[r.descIdx];
             device->CreateShaderResourceView(
                 d3dRsc, &srv.desc, r.descriptor);
         },
             [&](const _internalUAV &uav)
         {
+            renderPassFlags |= D3D12_RENDER_PASS_FLAG_ALLOW_UAV_WRITES;
+            if(r.persistentDesc || !createDescs)
+                return;
             r.descriptor = allGPUDescs[r.descIdx];
             device->CreateUnorderedAccessView(
                 d3dRsc, nullptr, &uav.desc, r.descriptor);
         },
             [&](const _internalRTV &rtv)
         {
-            r.descriptor = allRTVDescs[r.descIdx];
-            device->CreateRenderTargetView(
-                d3dRsc, &rtv.desc, r.descriptor);
+            if(!r.persistentDesc && createDescs)
+            {
+                r.descriptor = allRTVDescs[r.descIdx];
+                device->CreateRenderTargetView(
+                    d3dRsc, &rtv.desc, r.descriptor);
+            }
 
             if constexpr(IS_GRAPHICS)
             {
                 if(auto rtBinding = r.rtdsBinding.as_if<PassResource::RTB>();
-                    rtBinding)
+                    rtBinding && renderPassCmdList)
                 {
-                    renderTargetHandles.push_back(r.descriptor);
-                    if(rtBinding->clear)
+                    auto &rt = renderPassRTs[renderTargetCount++];
+                    rt.cpuDescriptor = r.descriptor;
+
+                    rt.BeginningAccess.Type =
+                        getChunkBeginAccess(rtBinding->beginAccess);
+                    if(rt.BeginningAccess.Type ==
+                        D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_CLEAR)
+                    {
+                        auto &clearValue = rt.BeginningAccess.Clear.ClearValue;
+                        clearValue.Format = rtv.desc.Format;
+                        std::memcpy(
+                            clearValue.Color, &rtBinding->clearColor.r,
+                            sizeof(clearValue.Color));
+                    }
+
+                    rt.EndingAccess.Type =
+                        getChunkEndAccess(rtBinding->endAccess);
+
+                    if(!firstRTVOrDSVDesc.Width)
+                    {
+                        firstRTVOrDSVDesc = rscNodes[r.rscIdx.idx]
+                            .getD3DResource()->GetDesc();
+                    }
+                }
+                else if(rtBinding)
+                {
+                    if(createDescs)
+                        data_.rtvHandles[renderTargetCount] = r.descriptor;
+                    ++renderTargetCount;
+
+                    if(rtBinding->clear && chunk.isFirst())
                     {
                         cmdList->ClearRenderTargetView(
                             r.descriptor,
@@ -153,17 +565,64 @@ bool FrameGraphPassNode::executeImpl(
         },
             [&](const _internalDSV &dsv)
         {
-            r.descriptor = allDSVDescs[r.descIdx];
-            device->CreateDepthStencilView(
-                d3dRsc, &dsv.desc, r.descriptor);
+            if(!r.persistentDesc && createDescs)
+            {
+                r.descriptor = allDSVDescs[r.descIdx];
+                device->CreateDepthStencilView(
+                    d3dRsc, &dsv.desc, r.descriptor);
+            }
 
             if constexpr(IS_GRAPHICS)
             {
                 if(auto dsBinding = r.rtdsBinding.as_if<PassResource::DSB>();
-                    dsBinding)
+                    dsBinding && renderPassCmdList)
                 {
                     depthStencilHandle = r.descriptor;
-                    if(dsBinding->clearDepth || dsBinding->clearStencil)
+                    renderPassDS.cpuDescriptor = r.descriptor;
+
+                    auto initAccess = [&](
+                        D3D12_RENDER_PASS_BEGINNING_ACCESS   &beginAccess,
+                        D3D12_RENDER_PASS_ENDING_ACCESS      &endAccess,
+                        D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE beginType,
+                        D3D12_RENDER_PASS_ENDING_ACCESS_TYPE    endType)
+                    {
+                        beginAccess.Type = beginType;
+                        if(beginType ==
+                            D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_CLEAR)
+                        {
+                            auto &clearValue = beginAccess.Clear.ClearValue;
+                            clearValue.Format = dsv.desc.Format;
+                            clearValue.DepthStencil.Depth =
+                                dsBinding->clearDethpStencil.depth;
+                            clearValue.DepthStencil.Stencil =
+                                dsBinding->clearDethpStencil.stencil;
+                        }
+                        endAccess.Type = endType;
+                    };
+
+                    initAccess(
+                        renderPassDS.DepthBeginningAccess,
+                        renderPassDS.DepthEndingAccess,
+                        getChunkBeginAccess(dsBinding->depthBeginAccess),
+                        getChunkEndAccess(dsBinding->depthEndAccess));
+
+                    initAccess(
+                        renderPassDS.StencilBeginningAccess,
+                        renderPassDS.StencilEndingAccess,
+                        getChunkBeginAccess(dsBinding->stencilBeginAccess),
+                        getChunkEndAccess(dsBinding->stencilEndAccess));
+
+                    if(!firstRTVOrDSVDesc.Width)
+                    {
+                        firstRTVOrDSVDesc = rscNodes[r.rscIdx.idx]
+                            .getD3DResource()->GetDesc();
+                    }
+                }
+                else if(dsBinding)
+                {
+                    depthStencilHandle = r.descriptor;
+                    if((dsBinding->clearDepth || dsBinding->clearStencil) &&
+                       chunk.isFirst())
                     {
                         const D3D12_CLEAR_FLAGS clearFlags =
                             dsBinding->clearDepth && dsBinding->clearStencil ?
@@ -194,36 +653,72 @@ bool FrameGraphPassNode::executeImpl(
 
     if constexpr(IS_GRAPHICS)
     {
-        if(!renderTargetHandles.empty())
+        // a render pass without any rt/ds gains nothing
+
+        if(renderPassCmdList && !renderTargetCount && !depthStencilHandle)
+            renderPassCmdList.Reset();
+
+        if(renderPassCmdList)
         {
-            if(depthStencilHandle)
-            {
-                cmdList->OMSetRenderTargets(
-                    static_cast<UINT>(renderTargetHandles.size()),
-                    renderTargetHandles.data(),
-                    false,
-                    &*depthStencilHandle);
-            }
-            else
+            if(!chunk.isFirst())
+                renderPassFlags |= D3D12_RENDER_PASS_FLAG_RESUMING_PASS;
+            if(!chunk.isLast())
+                renderPassFlags |= D3D12_RENDER_PASS_FLAG_SUSPENDING_PASS;
+
+            // merged passes are recorded in the render pass begun by
+            // the first of them
+
+            if(!data_.mergedWithPrev)
             {
-                cmdList->OMSetRenderTargets(
-                    static_cast<UINT>(renderTargetHandles.size()),
-                    renderTargetHandles.data(),
-                    false,
-                    nullptr);
+                renderPassCmdList->BeginRenderPass(
+                    static_cast<UINT>(renderTargetCount), renderPassRTs,
+                    depthStencilHandle ? &renderPassDS : nullptr,
+                    renderPassFlags);
             }
         }
+        else if(data_.mergedWithPrev && cmdListStates.renderTargetsBound)
+        {
+            // bound by the previous merged pass
+        }
         else
         {
-            if(depthStencilHandle)
+            const UINT rtCount = static_cast<UINT>(renderTargetCount);
+
+            auto isSameHandle = [](
+                const D3D12_CPU_DESCRIPTOR_HANDLE &a,
+                const D3D12_CPU_DESCRIPTOR_HANDLE &b)
             {
-                cmdList->OMSetRenderTargets(
-                    0, nullptr, false, &*depthStencilHandle);
-            }
+                return a.ptr == b.ptr;
+            };
+
+            const bool isBound =
+                cmdListStates.renderTargetsBound &&
+                cmdListStates.renderTargetCount == rtCount &&
+                std::equal(
+                    data_.rtvHandles.begin(),
+                    data_.rtvHandles.begin() + rtCount,
+                    cmdListStates.renderTargets, isSameHandle) &&
+                cmdListStates.hasDepthStencil == depthStencilHandle.has_value() &&
+                (!depthStencilHandle ||
+                 isSameHandle(cmdListStates.depthStencil, *depthStencilHandle));
+
+            if(cmdListStates.filter && isBound)
+                ++cmdListStates.filtered.renderTargets;
             else
             {
                 cmdList->OMSetRenderTargets(
-                    0, nullptr, false, nullptr);
+                    rtCount, rtCount ? data_.rtvHandles.data : nullptr, false,
+                    depthStencilHandle ? &*depthStencilHandle : nullptr);
+
+                cmdListStates.renderTargetsBound = true;
+                cmdListStates.renderTargetCount  = rtCount;
+                std::copy(
+                    data_.rtvHandles.begin(),
+                    data_.rtvHandles.begin() + rtCount,
+                    cmdListStates.renderTargets);
+                cmdListStates.hasDepthStencil = depthStencilHandle.has_value();
+                if(depthStencilHandle)
+                    cmdListStates.depthStencil = *depthStencilHandle;
             }
         }
     }
@@ -232,46 +727,109 @@ bool FrameGraphPassNode::executeImpl(
 
     if constexpr(IS_GRAPHICS)
     {
-        cmdList->RSSetViewports(
-            static_cast<UINT>(viewport_.viewports.size()),
-            viewport_.viewports.data());
+        auto isBound = [](const auto *bound, const auto &states)
+        {
+            return bound && bound->size() == states.size() &&
+                   std::memcmp(
+                       bound->data(), states.data(),
+                       states.size() * sizeof(states[0])) == 0;
+        };
+
+        if(cmdListStates.filter &&
+           isBound(cmdListStates.viewports, viewport_.viewports))
+            ++cmdListStates.filtered.viewports;
+        else
+        {
+            cmdList->RSSetViewports(
+                static_cast<UINT>(viewport_.viewports.size()),
+                viewport_.viewports.data());
+            cmdListStates.viewports = &viewport_.viewports;
+        }
 
-        cmdList->RSSetScissorRects(
-            static_cast<UINT>(viewport_.scissors.size()),
-            viewport_.scissors.data());
+        if(cmdListStates.filter &&
+           isBound(cmdListStates.scissors, viewport_.scissors))
+            ++cmdListStates.filtered.scissors;
+        else
+        {
+            cmdList->RSSetScissorRects(
+                static_cast<UINT>(viewport_.scissors.size()),
+                viewport_.scissors.data());
+            cmdListStates.scissors = &viewport_.scissors;
+        }
     }
 
     // pipeline state
 
     if(pipelineState_)
-        cmdList->SetPipelineState(pipelineState_.Get());
+    {
+        if(cmdListStates.filter &&
+           cmdListStates.pipelineState == pipelineState_.Get())
+            ++cmdListStates.filtered.pipelineStates;
+        else
+        {
+            cmdList->SetPipelineState(pipelineState_.Get());
+            cmdListStates.pipelineState = pipelineState_.Get();
+        }
+    }
 
-    // root signature
+    // root signature. graphics & compute ones are bound separately
 
     if(rootSignature_)
     {
-        if constexpr(IS_GRAPHICS)
-            cmdList->SetGraphicsRootSignature(rootSignature_.Get());
+        auto &boundRootSignature = IS_GRAPHICS ?
+            cmdListStates.graphicsRootSignature :
+            cmdListStates.computeRootSignature;
+
+        if(cmdListStates.filter && boundRootSignature == rootSignature_.Get())
+            ++cmdListStates.filtered.rootSignatures;
         else
-            cmdList->SetComputeRootSignature(rootSignature_.Get());
+        {
+            if constexpr(IS_GRAPHICS)
+                cmdList->SetGraphicsRootSignature(rootSignature_.Get());
+            else
+                cmdList->SetComputeRootSignature(rootSignature_.Get());
+            boundRootSignature = rootSignature_.Get();
+        }
     }
 
     // pass func context
 
     FrameGraphPassContext passCtx(
-        rscNodes, *this, allGPUDescs, allRTVDescs, allDSVDescs);
+        rscNodes, *this, allGPUDescs, allRTVDescs, allDSVDescs, chunk);
 
     // call pass func
 
-    assert(passFunc_);
-    passFunc_(cmdList, passCtx);
+    if(bundle_)
+    {
+        cmdList->ExecuteBundle(bundle_.Get());
+
+        // pipeline state & root signature set in the bundle are kept
+
+        cmdListStates.pipelineState         = nullptr;
+        cmdListStates.graphicsRootSignature = nullptr;
+    }
+    else
+    {
+        assert(passFunc_);
+        passFunc_(cmdList, passCtx);
+    }
+
+    if(passCtx.isBoundStatesInvalidated())
+        cmdListStates.invalidate();
+
+    if(renderPassCmdList && !data_.mergedWithNext)
+    {
+        renderPassCmdList->EndRenderPass();
+        cmdListStates.renderTargetsBound = false;
+    }
 
     // final state transitions
 
-    if(!outBarriers.empty())
+    if(outBarrierCount)
     {
         cmdList->ResourceBarrier(
-            static_cast<UINT>(outBarriers.size()), outBarriers.data());
+            static_cast<UINT>(outBarrierCount),
+            barriers.data + barriers.size - outBarrierCount);
     }
 
     return passCtx.isCmdListSubmissionRequested();
@@ -283,15 +841,21 @@ bool FrameGraphPassNode::execute(
     DescriptorRange                      allGPUDescs,
     DescriptorRange                      allRTVDescs,
     DescriptorRange                      allDSVDescs,
+    size_t                               passIdx,
+    FrameGraphPassRange                  cmdListPasses,
+    FrameGraphPassChunk                  chunk,
+    FrameGraphCmdListStates             &cmdListStates,
     ID3D12GraphicsCommandList           *cmdList) const
 {
     if(isGraphics_)
     {
         return executeImpl<true>(
-            device, rscNodes, allGPUDescs, allRTVDescs, allDSVDescs, cmdList);
+            device, rscNodes, allGPUDescs, allRTVDescs, allDSVDescs,
+            passIdx, cmdListPasses, chunk, cmdListStates, cmdList);
     }
     return executeImpl<false>(
-        device, rscNodes, allGPUDescs, allRTVDescs, allDSVDescs, cmdList);
+        device, rscNodes, allGPUDescs, allRTVDescs, allDSVDescs,
+        passIdx, cmdListPasses, chunk, cmdListStates, cmdList);
 }
 
 AGZ_D3D12_FG_END
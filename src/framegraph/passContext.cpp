@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include <agz/d3d12/framegraph/passContext.h>
 
 AGZ_D3D12_FG_BEGIN
@@ -7,9 +9,12 @@ FrameGraphPassContext::FrameGraphPassContext(
     const FrameGraphPassNode                  &passNode,
     DescriptorRange                            allGPUDescs,
     DescriptorRange                            allRTVDescs,
-    DescriptorRange                            allDSVDescs) noexcept
-    : requestCmdListSubmission_(false), rscNodes_(rscNodes), passNode_(passNode),
-      allGPUDescs_(allGPUDescs), allRTVDescs_(allRTVDescs), allDSVDescs_(allDSVDescs)
+    DescriptorRange                            allDSVDescs,
+    FrameGraphPassChunk                        chunk) noexcept
+    : requestCmdListSubmission_(false), boundStatesInvalidated_(false),
+      rscNodes_(rscNodes), passNode_(passNode),
+      allGPUDescs_(allGPUDescs), allRTVDescs_(allRTVDescs), allDSVDescs_(allDSVDescs),
+      chunk_(chunk)
 {
     
 }
@@ -17,15 +22,40 @@ FrameGraphPassContext::FrameGraphPassContext(
 FrameGraphPassContext::Resource FrameGraphPassContext::getResource(
     ResourceIndex index) const
 {
-    const auto it = passNode_.rscs_.find(index);
-    if(it == passNode_.rscs_.end())
-        return {};
+    return getResource(index, 0);
+}
+
+FrameGraphPassContext::Resource FrameGraphPassContext::getResource(
+    ResourceIndex index, size_t usageIdx) const
+{
+    const auto &rscs = passNode_.data_.rscs;
+
+    auto it = std::lower_bound(
+        rscs.begin(), rscs.end(), index,
+        [](const FrameGraphPassNode::PassResource &r, ResourceIndex i)
+    {
+        return r.rscIdx < i;
+    });
 
-    Resource ret;
-    ret.rsc          = rscNodes_[index.idx].getD3DResource();
-    ret.currentState = it->second.afterState;
-    ret.descriptor   = it->second.descriptor;
-    return ret;
+    // usages of the rsc are stored in declaration order, each followed
+    // by states of its other subresources
+
+    for(; it != rscs.end() && it->rscIdx.idx == index.idx; ++it)
+    {
+        if(it->trackOnly)
+            continue;
+
+        if(usageIdx--)
+            continue;
+
+        Resource ret;
+        ret.rsc          = rscNodes_[index.idx].getD3DResource();
+        ret.currentState = it->inState;
+        ret.descriptor   = it->descriptor;
+        return ret;
+    }
+
+    return {};
 }
 
 void FrameGraphPassContext::requestCmdListSubmission() noexcept
@@ -38,4 +68,24 @@ bool FrameGraphPassContext::isCmdListSubmissionRequested() const noexcept
     return requestCmdListSubmission_;
 }
 
+void FrameGraphPassContext::invalidateBoundStates() noexcept
+{
+    boundStatesInvalidated_ = true;
+}
+
+bool FrameGraphPassContext::isBoundStatesInvalidated() const noexcept
+{
+    return boundStatesInvalidated_;
+}
+
+uint32_t FrameGraphPassContext::getChunkIndex() const noexcept
+{
+    return chunk_.idx;
+}
+
+uint32_t FrameGraphPassContext::getChunkCount() const noexcept
+{
+    return chunk_.count;
+}
+
 AGZ_D3D12_FG_END
@@ -0,0 +1,520 @@
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include <agz/d3d12/framegraph/profiler.h>
+
+AGZ_D3D12_FG_BEGIN
+
+namespace
+{
+
+    INT64 getQPC() noexcept
+    {
+        LARGE_INTEGER ret;
+        QueryPerformanceCounter(&ret);
+        return ret.QuadPart;
+    }
+
+    struct TimeStatistics
+    {
+        float min = 0;
+        float avg = 0;
+        float p99 = 0;
+    };
+
+    TimeStatistics computeStatistics(std::vector<float> samples)
+    {
+        TimeStatistics ret;
+        if(samples.empty())
+            return ret;
+
+        std::sort(samples.begin(), samples.end());
+
+        float sum = 0;
+        for(float s : samples)
+            sum += s;
+
+        const size_t p99Idx = (std::min)(
+            samples.size() - 1, samples.size() * 99 / 100);
+
+        ret.min = samples.front();
+        ret.avg = sum / samples.size();
+        ret.p99 = samples[p99Idx];
+
+        return ret;
+    }
+
+    void writeEscapedString(std::ostream &out, const std::string &str)
+    {
+        out << '"';
+        for(char c : str)
+        {
+            if(c == '"' || c == '\\')
+                out << '\\' << c;
+            else if(static_cast<unsigned char>(c) < 0x20)
+                out << ' ';
+            else
+                out << c;
+        }
+        out << '"';
+    }
+
+    const char *getQueueName(FrameGraphQueue queue) noexcept
+    {
+        switch(queue)
+        {
+        case FrameGraphQueue::Graphics: return "graphics queue";
+        case FrameGraphQueue::Compute:  return "compute queue";
+        case FrameGraphQueue::Copy:     return "copy queue";
+        }
+        return "unknown queue";
+    }
+
+} // namespace anonymous
+
+FrameGraphProfiler::FrameGraphProfiler(ID3D12Device *device, int frameCount)
+    : device_(device),
+      qpcFrequency_(1),
+      qpcEpoch_(0),
+      frameSlots_(frameCount),
+      currentSlot_(nullptr),
+      graphicsQueue_(nullptr),
+      collectedFrameCount_(0)
+{
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    qpcFrequency_ = freq.QuadPart;
+    qpcEpoch_     = getQPC();
+}
+
+void FrameGraphProfiler::setOptions(const FrameGraphProfilingOptions &options)
+{
+    options_ = options;
+    options_.statisticsFrameCount = (std::max<size_t>)(
+        options_.statisticsFrameCount, 1);
+
+    passHistories_.clear();
+    traceFrames_.clear();
+}
+
+const FrameGraphProfilingOptions &FrameGraphProfiler::getOptions() const noexcept
+{
+    return options_;
+}
+
+void FrameGraphProfiler::startFrame(int frameIndex)
+{
+    currentSlot_ = &frameSlots_[frameIndex];
+    if(currentSlot_->pending)
+        collectFrame(*currentSlot_);
+}
+
+void FrameGraphProfiler::beginExecution(
+    const FrameGraphData      &graph,
+    const FrameGraphCmdQueues &cmdQueues)
+{
+    assert(currentSlot_ && !currentSlot_->pending);
+    auto &slot = *currentSlot_;
+
+    // a begin & an end timestamp per pass
+
+    const size_t queryCount = 2 * graph.passNodes.size();
+    if(slot.queryCapacity < queryCount)
+    {
+        const size_t newCapacity = (std::max)(
+            queryCount, 2 * slot.queryCapacity);
+
+        D3D12_QUERY_HEAP_DESC heapDesc;
+        heapDesc.Type     = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+        heapDesc.Count    = static_cast<UINT>(newCapacity);
+        heapDesc.NodeMask = 0;
+
+        slot.queryHeap.Reset();
+        AGZ_D3D12_CHECK_HR(
+            device_->CreateQueryHeap(
+                &heapDesc, IID_PPV_ARGS(slot.queryHeap.GetAddressOf())));
+
+        const CD3DX12_HEAP_PROPERTIES readbackProp(D3D12_HEAP_TYPE_READBACK);
+        const auto readbackDesc = CD3DX12_RESOURCE_DESC::Buffer(
+            sizeof(UINT64) * newCapacity);
+
+        slot.readbackBuffer.Reset();
+        AGZ_D3D12_CHECK_HR(
+            device_->CreateCommittedResource(
+                &readbackProp, D3D12_HEAP_FLAG_NONE,
+                &readbackDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+                IID_PPV_ARGS(slot.readbackBuffer.GetAddressOf())));
+
+        slot.queryCapacity = newCapacity;
+    }
+
+    graphicsQueue_ = cmdQueues[static_cast<int>(FrameGraphQueue::Graphics)];
+
+    slot.passNames = graph.passNames;
+
+    slot.passRecords.resize(graph.passNodes.size());
+    for(size_t i = 0; i < graph.passNodes.size(); ++i)
+    {
+        slot.passRecords[i] = {};
+        slot.passRecords[i].queue = graph.passSyncs[i].queue;
+    }
+
+    // timestamp queries are not supported by copy queues without
+    // D3D12_FEATURE_DATA_D3D12_OPTIONS3::CopyQueueTimestampQueriesSupported
+
+    for(int q = 0; q < FRAME_GRAPH_QUEUE_COUNT; ++q)
+    {
+        slot.hasQueue[q] = cmdQueues[q] &&
+            static_cast<FrameGraphQueue>(q) != FrameGraphQueue::Copy;
+        if(!slot.hasQueue[q])
+            continue;
+
+        AGZ_D3D12_CHECK_HR(
+            cmdQueues[q]->GetTimestampFrequency(&slot.gpuFrequency[q]));
+        AGZ_D3D12_CHECK_HR(
+            cmdQueues[q]->GetClockCalibration(
+                &slot.gpuCalibration[q], &slot.cpuCalibration[q]));
+    }
+}
+
+void FrameGraphProfiler::beginPass(
+    size_t passIdx, int threadIndex,
+    ID3D12GraphicsCommandList *cmdList) noexcept
+{
+    auto &slot   = *currentSlot_;
+    auto &record = slot.passRecords[passIdx];
+
+    record.threadIndex = threadIndex;
+
+    if(slot.hasQueue[static_cast<int>(record.queue)])
+    {
+        cmdList->EndQuery(
+            slot.queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+            static_cast<UINT>(2 * passIdx));
+    }
+
+    record.cpuBeg = getQPC();
+}
+
+void FrameGraphProfiler::endPass(
+    size_t passIdx, ID3D12GraphicsCommandList *cmdList) noexcept
+{
+    auto &slot   = *currentSlot_;
+    auto &record = slot.passRecords[passIdx];
+
+    record.cpuEnd = getQPC();
+
+    if(slot.hasQueue[static_cast<int>(record.queue)])
+    {
+        cmdList->EndQuery(
+            slot.queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+            static_cast<UINT>(2 * passIdx + 1));
+    }
+}
+
+void FrameGraphProfiler::endExecution(CommandListPool &cmdListPool)
+{
+    auto &slot = *currentSlot_;
+
+    const UINT queryCount = static_cast<UINT>(2 * slot.passRecords.size());
+    if(!queryCount)
+        return;
+
+    // the graphics queue has waited for other queues in joinQueues,
+    // so all timestamps are written before resolving
+
+    auto cmdList = cmdListPool.requireCommandList(
+        0, FrameGraphQueue::Graphics);
+
+    // resolving unwritten queries is invalid.
+    // fill queries of unmeasured passes with dummy timestamps
+
+    for(size_t i = 0; i < slot.passRecords.size(); ++i)
+    {
+        if(slot.hasQueue[static_cast<int>(slot.passRecords[i].queue)])
+            continue;
+
+        for(UINT q = 0; q < 2; ++q)
+        {
+            cmdList->EndQuery(
+                slot.queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+                static_cast<UINT>(2 * i + q));
+        }
+    }
+
+    cmdList->ResolveQueryData(
+        slot.queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+        0, queryCount, slot.readbackBuffer.Get(), 0);
+
+    cmdList->Close();
+
+    ID3D12CommandList *rawCmdList = cmdList.Get();
+    graphicsQueue_->ExecuteCommandLists(1, &rawCmdList);
+
+    cmdListPool.addUnusedCommandList(
+        FrameGraphQueue::Graphics, std::move(cmdList));
+
+    slot.pending = true;
+}
+
+std::vector<FrameGraphPassProfile> FrameGraphProfiler::getPassProfiles() const
+{
+    std::vector<FrameGraphPassProfile> ret;
+    ret.reserve(passHistories_.size());
+
+    for(auto &[name, history] : passHistories_)
+    {
+        FrameGraphPassProfile profile;
+        profile.name       = name;
+        profile.queue      = history.queue;
+        profile.frameCount = history.cpuTimes.size();
+
+        const auto cpu = computeStatistics(history.cpuTimes);
+        profile.cpuMin = cpu.min;
+        profile.cpuAvg = cpu.avg;
+        profile.cpuP99 = cpu.p99;
+
+        const bool hasGPUTimes = std::none_of(
+            history.gpuTimes.begin(), history.gpuTimes.end(),
+            [](float t) { return t < 0; });
+
+        if(hasGPUTimes)
+        {
+            const auto gpu = computeStatistics(history.gpuTimes);
+            profile.gpuMin = gpu.min;
+            profile.gpuAvg = gpu.avg;
+            profile.gpuP99 = gpu.p99;
+        }
+
+        ret.push_back(std::move(profile));
+    }
+
+    // in execution order of the latest frame
+
+    std::stable_sort(ret.begin(), ret.end(),
+        [&](const FrameGraphPassProfile &a, const FrameGraphPassProfile &b)
+    {
+        return passHistories_.at(a.name).passIdx <
+               passHistories_.at(b.name).passIdx;
+    });
+
+    return ret;
+}
+
+std::string FrameGraphProfiler::exportChromeTrace() const
+{
+    constexpr int CPU_PID = 0;
+    constexpr int GPU_PID = 1;
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+
+    out << "{\"traceEvents\":[";
+
+    bool first = true;
+    auto beginEvent = [&]
+    {
+        if(!first)
+            out << ',';
+        out << '\n';
+        first = false;
+    };
+
+    std::set<int> cpuThreads;
+    std::set<int> gpuQueues;
+
+    for(auto &frame : traceFrames_)
+    {
+        for(auto &e : frame)
+        {
+            (e.gpu ? gpuQueues : cpuThreads).insert(e.tid);
+
+            beginEvent();
+            out << "{\"name\":";
+            writeEscapedString(out, e.name);
+            out << ",\"cat\":\"" << (e.gpu ? "gpu" : "cpu") << "\""
+                << ",\"ph\":\"X\""
+                << ",\"pid\":" << (e.gpu ? GPU_PID : CPU_PID)
+                << ",\"tid\":" << e.tid
+                << ",\"ts\":" << e.ts
+                << ",\"dur\":" << e.dur << "}";
+        }
+    }
+
+    auto writeName = [&](
+        const char *type, int pid, int tid, const std::string &name)
+    {
+        beginEvent();
+        out << "{\"name\":\"" << type << "\",\"ph\":\"M\""
+            << ",\"pid\":" << pid << ",\"tid\":" << tid
+            << ",\"args\":{\"name\":";
+        writeEscapedString(out, name);
+        out << "}}";
+    };
+
+    writeName("process_name", CPU_PID, 0, "frame graph cpu");
+    writeName("process_name", GPU_PID, 0, "frame graph gpu");
+
+    for(int t : cpuThreads)
+        writeName("thread_name", CPU_PID, t, "thread " + std::to_string(t));
+
+    for(int q : gpuQueues)
+    {
+        writeName(
+            "thread_name", GPU_PID, q,
+            getQueueName(static_cast<FrameGraphQueue>(q)));
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    return out.str();
+}
+
+void FrameGraphProfiler::collectFrame(FrameSlot &slot)
+{
+    slot.pending = false;
+
+    const size_t passCount  = slot.passRecords.size();
+    const size_t queryCount = 2 * passCount;
+
+    const D3D12_RANGE readRange = { 0, sizeof(UINT64) * queryCount };
+    UINT64 *timestamps = nullptr;
+    AGZ_D3D12_CHECK_HR(
+        slot.readbackBuffer->Map(
+            0, &readRange, reinterpret_cast<void **>(&timestamps)));
+
+    // passes with the same name are accumulated in a frame
+
+    struct FrameSample
+    {
+        FrameGraphQueue queue;
+        size_t passIdx;
+        float cpuTime;
+        float gpuTime;
+    };
+
+    std::map<std::string, FrameSample> frameSamples;
+    std::vector<TraceEvent> traceEvents;
+
+    for(size_t i = 0; i < passCount; ++i)
+    {
+        auto &record = slot.passRecords[i];
+        auto &name   = slot.passNames[i];
+        const int q  = static_cast<int>(record.queue);
+
+        const float cpuTime = static_cast<float>(
+            qpcToMicroseconds(record.cpuEnd) -
+            qpcToMicroseconds(record.cpuBeg));
+
+        TraceEvent cpuEvent;
+        cpuEvent.name = name;
+        cpuEvent.gpu  = false;
+        cpuEvent.tid  = record.threadIndex;
+        cpuEvent.ts   = qpcToMicroseconds(record.cpuBeg);
+        cpuEvent.dur  = cpuTime;
+        traceEvents.push_back(std::move(cpuEvent));
+
+        float gpuTime = -1;
+        if(slot.hasQueue[q])
+        {
+            const UINT64 gpuBeg = timestamps[2 * i];
+            const UINT64 gpuEnd = (std::max)(gpuBeg, timestamps[2 * i + 1]);
+
+            const double gpuFreq = static_cast<double>(slot.gpuFrequency[q]);
+            gpuTime = static_cast<float>((gpuEnd - gpuBeg) * 1e6 / gpuFreq);
+
+            // gpu ticks -> qpc ticks via the calibration of the queue
+
+            const double gpuOffset =
+                static_cast<double>(gpuBeg) -
+                static_cast<double>(slot.gpuCalibration[q]);
+            const double qpcBeg =
+                static_cast<double>(slot.cpuCalibration[q]) +
+                gpuOffset * qpcFrequency_ / gpuFreq;
+
+            TraceEvent gpuEvent;
+            gpuEvent.name = name;
+            gpuEvent.gpu  = true;
+            gpuEvent.tid  = q;
+            gpuEvent.ts   = (qpcBeg - qpcEpoch_) * 1e6 / qpcFrequency_;
+            gpuEvent.dur  = gpuTime;
+            traceEvents.push_back(std::move(gpuEvent));
+        }
+
+        auto it = frameSamples.find(name);
+        if(it == frameSamples.end())
+            frameSamples.insert({ name, { record.queue, i, cpuTime, gpuTime } });
+        else
+        {
+            it->second.cpuTime += cpuTime;
+            if(it->second.gpuTime >= 0 && gpuTime >= 0)
+                it->second.gpuTime += gpuTime;
+            else
+                it->second.gpuTime = -1;
+        }
+    }
+
+    const D3D12_RANGE writeRange = { 0, 0 };
+    slot.readbackBuffer->Unmap(0, &writeRange);
+
+    ++collectedFrameCount_;
+
+    for(auto &[name, sample] : frameSamples)
+    {
+        addSample(
+            name, sample.queue, sample.passIdx,
+            sample.cpuTime, sample.gpuTime);
+    }
+
+    // drop passes not seen in the statistics window
+
+    for(auto it = passHistories_.begin(); it != passHistories_.end();)
+    {
+        if(it->second.lastFrame + options_.statisticsFrameCount <=
+           collectedFrameCount_)
+            it = passHistories_.erase(it);
+        else
+            ++it;
+    }
+
+    if(options_.traceFrameCount)
+    {
+        traceFrames_.push_back(std::move(traceEvents));
+        while(traceFrames_.size() > options_.traceFrameCount)
+            traceFrames_.pop_front();
+    }
+}
+
+void FrameGraphProfiler::addSample(
+    const std::string &name, FrameGraphQueue queue, size_t passIdx,
+    float cpuTime, float gpuTime)
+{
+    auto &history = passHistories_[name];
+    history.queue     = queue;
+    history.passIdx   = passIdx;
+    history.lastFrame = collectedFrameCount_;
+
+    if(history.cpuTimes.size() < options_.statisticsFrameCount)
+    {
+        history.cpuTimes.push_back(cpuTime);
+        history.gpuTimes.push_back(gpuTime);
+    }
+    else
+    {
+        history.cpuTimes[history.nextSample] = cpuTime;
+        history.gpuTimes[history.nextSample] = gpuTime;
+    }
+
+    history.nextSample =
+        (history.nextSample + 1) % options_.statisticsFrameCount;
+}
+
+double FrameGraphProfiler::qpcToMicroseconds(INT64 qpc) const noexcept
+{
+    return static_cast<double>(qpc - qpcEpoch_) * 1e6 / qpcFrequency_;
+}
+
+AGZ_D3D12_FG_END
@@ -0,0 +1,535 @@
+#include <sstream>
+
+#include <agz/d3d12/framegraph/report.h>
+
+AGZ_D3D12_FG_BEGIN
+
+namespace
+{
+
+    constexpr D3D12_RESOURCE_STATES WRITE_STATES =
+        D3D12_RESOURCE_STATE_RENDER_TARGET |
+        D3D12_RESOURCE_STATE_UNORDERED_ACCESS |
+        D3D12_RESOURCE_STATE_DEPTH_WRITE |
+        D3D12_RESOURCE_STATE_STREAM_OUT |
+        D3D12_RESOURCE_STATE_COPY_DEST |
+        D3D12_RESOURCE_STATE_RESOLVE_DEST;
+
+    std::string stateToString(D3D12_RESOURCE_STATES state)
+    {
+        if(state == D3D12_RESOURCE_STATE_COMMON)
+            return "COMMON";
+
+        if(state == D3D12_RESOURCE_STATE_GENERIC_READ)
+            return "GENERIC_READ";
+
+        static const std::pair<D3D12_RESOURCE_STATES, const char *> NAMES[] =
+        {
+            { D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, "VERTEX_AND_CONSTANT_BUFFER" },
+            { D3D12_RESOURCE_STATE_INDEX_BUFFER,               "INDEX_BUFFER"               },
+            { D3D12_RESOURCE_STATE_RENDER_TARGET,              "RENDER_TARGET"              },
+            { D3D12_RESOURCE_STATE_UNORDERED_ACCESS,           "UNORDERED_ACCESS"           },
+            { D3D12_RESOURCE_STATE_DEPTH_WRITE,                "DEPTH_WRITE"                },
+            { D3D12_RESOURCE_STATE_DEPTH_READ,                 "DEPTH_READ"                 },
+            { D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,  "NON_PIXEL_SHADER_RESOURCE"  },
+            { D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,      "PIXEL_SHADER_RESOURCE"      },
+            { D3D12_RESOURCE_STATE_STREAM_OUT,                 "STREAM_OUT"                 },
+            { D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,          "INDIRECT_ARGUMENT"          },
+            { D3D12_RESOURCE_STATE_COPY_DEST,                  "COPY_DEST"                  },
+            { D3D12_RESOURCE_STATE_COPY_SOURCE,                "COPY_SOURCE"                },
+            { D3D12_RESOURCE_STATE_RESOLVE_DEST,               "RESOLVE_DEST"               },
+            { D3D12_RESOURCE_STATE_RESOLVE_SOURCE,             "RESOLVE_SOURCE"             },
+        };
+
+        std::string ret;
+        auto rest = static_cast<UINT64>(state);
+
+        for(auto &[s, name] : NAMES)
+        {
+            if((rest & s) == static_cast<UINT64>(s))
+            {
+                if(!ret.empty())
+                    ret += "|";
+                ret += name;
+                rest &= ~static_cast<UINT64>(s);
+            }
+        }
+
+        if(rest)
+        {
+            if(!ret.empty())
+                ret += "|";
+            ret += std::to_string(rest);
+        }
+
+        return ret;
+    }
+
+    const char *barrierTypeToString(FrameGraphReportBarrier::Type type)
+    {
+        switch(type)
+        {
+        case FrameGraphReportBarrier::Type::Transition: return "transition";
+        case FrameGraphReportBarrier::Type::SplitBegin: return "split_begin";
+        case FrameGraphReportBarrier::Type::SplitEnd:   return "split_end";
+        case FrameGraphReportBarrier::Type::Aliasing:   return "aliasing";
+        case FrameGraphReportBarrier::Type::UAV:        return "uav";
+        }
+        return "unknown";
+    }
+
+    const char *queueToString(FrameGraphQueue queue)
+    {
+        switch(queue)
+        {
+        case FrameGraphQueue::Graphics: return "graphics";
+        case FrameGraphQueue::Compute:  return "compute";
+        case FrameGraphQueue::Copy:     return "copy";
+        }
+        return "unknown";
+    }
+
+    std::string escape(const std::string &str)
+    {
+        std::string ret;
+        ret.reserve(str.size());
+        for(char c : str)
+        {
+            if(c == '"' || c == '\\')
+            {
+                ret += '\\';
+                ret += c;
+            }
+            else if(static_cast<unsigned char>(c) < 0x20)
+                ret += ' ';
+            else
+                ret += c;
+        }
+        return ret;
+    }
+
+    void writeBarriersJSON(
+        std::ostream &out, const std::vector<FrameGraphReportBarrier> &barriers)
+    {
+        out << "[";
+        for(size_t i = 0; i < barriers.size(); ++i)
+        {
+            auto &b = barriers[i];
+            out << (i ? "," : "")
+                << "{\"type\":\"" << barrierTypeToString(b.type) << "\""
+                << ",\"rsc\":" << b.rscIdx;
+            if(b.type != FrameGraphReportBarrier::Type::Aliasing &&
+               b.type != FrameGraphReportBarrier::Type::UAV)
+            {
+                out << ",\"before\":\"" << stateToString(b.beforeState) << "\""
+                    << ",\"after\":\""  << stateToString(b.afterState)  << "\"";
+                if(b.subresource != D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES)
+                    out << ",\"subresource\":" << b.subresource;
+            }
+            out << "}";
+        }
+        out << "]";
+    }
+
+    std::string getRscLabel(const FrameGraphReportResource &rsc)
+    {
+        std::string ret = "rsc " + std::to_string(rsc.idx);
+        if(rsc.isExternal)
+            ret += " (external)";
+
+        if(rsc.isCulled)
+            return ret + "\\nculled";
+
+        ret += "\\n";
+        if(rsc.desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+            ret += "buffer " + std::to_string(rsc.desc.Width);
+        else
+        {
+            ret += std::to_string(rsc.desc.Width) + "x" +
+                   std::to_string(rsc.desc.Height) + "x" +
+                   std::to_string(rsc.desc.DepthOrArraySize) +
+                   " fmt " + std::to_string(rsc.desc.Format);
+        }
+
+        if(!rsc.isExternal)
+        {
+            ret += "\\n" + std::to_string(rsc.byteSize) + " bytes";
+            if(rsc.isAliased)
+                ret += ", aliased";
+        }
+
+        return ret;
+    }
+
+} // namespace anonymous
+
+FrameGraphReport createFrameGraphReport(
+    ID3D12Device *device, const FrameGraphData &graph)
+{
+    FrameGraphReport ret;
+
+    ret.gpuDescCount      = graph.gpuDescCount;
+    ret.rtvDescCount      = graph.rtvDescCount;
+    ret.dsvDescCount      = graph.dsvDescCount;
+    ret.graphGPUDescCount = graph.graphGPUDescCount;
+    ret.graphRTVDescCount = graph.graphRTVDescCount;
+    ret.graphDSVDescCount = graph.graphDSVDescCount;
+    ret.statistics        = graph.statistics;
+
+    // rscs
+
+    ret.rscs.resize(graph.rscNodes.size());
+    for(size_t i = 0; i < graph.rscNodes.size(); ++i)
+    {
+        auto &node = graph.rscNodes[i];
+        auto &rsc  = ret.rscs[i];
+
+        rsc.idx        = static_cast<int32_t>(i);
+        rsc.isExternal = node.isExternal();
+
+        auto d3dRsc = node.getD3DResource();
+        if(!d3dRsc)
+        {
+            rsc.isCulled = !rsc.isExternal;
+            continue;
+        }
+
+        rsc.desc     = d3dRsc->GetDesc();
+        rsc.byteSize = device->GetResourceAllocationInfo(
+            0, 1, &rsc.desc).SizeInBytes;
+
+        if(!rsc.isExternal)
+            ret.internalMemory += rsc.byteSize;
+    }
+
+    for(auto &r : graph.relativeRscs)
+        ret.rscs[r.rscIdx].isBackbufferRelative = true;
+
+    for(size_t h = 0; h < graph.historyRings.size(); ++h)
+    {
+        auto &ring = graph.historyRings[h];
+        for(size_t k = 0; k < ring.rscs.size(); ++k)
+        {
+            auto &rsc = ret.rscs[ring.firstRsc + k];
+            rsc.historyRing          = static_cast<int32_t>(h);
+            rsc.isBackbufferRelative = ring.relativeSize.has_value();
+        }
+    }
+
+    // passes
+
+    ret.passes.resize(graph.passNodes.size());
+    for(size_t i = 0; i < graph.passNodes.size(); ++i)
+    {
+        auto &node = graph.passNodes[i];
+        auto &pass = ret.passes[i];
+
+        pass.name       = graph.passNames[i];
+        pass.declIdx    = graph.passDeclIndices[i].idx;
+        pass.isGraphics = node.isGraphics();
+        pass.sync       = graph.passSyncs[i];
+
+        const auto passIdx = static_cast<int32_t>(i);
+
+        for(auto &r : node.getPassData().rscs)
+        {
+            const int32_t rscIdx = r.rscIdx.idx;
+
+            if(!r.trackOnly)
+            {
+                FrameGraphReportPassResource passRsc;
+                passRsc.rscIdx  = rscIdx;
+                passRsc.inState = r.inState;
+
+                match_variant(r.viewDesc,
+                    [&](const _internalSRV &) { passRsc.view = "srv"; },
+                    [&](const _internalUAV &) { passRsc.view = "uav"; },
+                    [&](const _internalRTV &) { passRsc.view = "rtv"; },
+                    [&](const _internalDSV &) { passRsc.view = "dsv"; },
+                    [&](const std::monostate &) { });
+
+                pass.rscs.push_back(std::move(passRsc));
+            }
+
+            // transitions are issued per subresource when the pass rsc
+            // covers only some of them
+
+            auto addTransitions = [&](
+                std::vector<FrameGraphReportBarrier> &barriers,
+                FrameGraphReportBarrier::Type type,
+                D3D12_RESOURCE_STATES beforeState,
+                D3D12_RESOURCE_STATES afterState,
+                size_t &counter)
+            {
+                FrameGraphReportBarrier b;
+                b.type        = type;
+                b.rscIdx      = rscIdx;
+                b.beforeState = beforeState;
+                b.afterState  = afterState;
+
+                if(!r.subresources.size)
+                {
+                    barriers.push_back(b);
+                    ++counter;
+                    return;
+                }
+
+                for(UINT subrsc : r.subresources)
+                {
+                    b.subresource = subrsc;
+                    barriers.push_back(b);
+                    ++counter;
+                }
+            };
+
+            auto &rsc = ret.rscs[rscIdx];
+            if(rsc.firstPass < 0)
+                rsc.firstPass = passIdx;
+            rsc.lastPass = passIdx;
+
+            // same order as in FrameGraphPassNode::execute
+
+            if(r.aliasingBarrier)
+            {
+                rsc.isAliased = true;
+
+                FrameGraphReportBarrier b;
+                b.type   = FrameGraphReportBarrier::Type::Aliasing;
+                b.rscIdx = rscIdx;
+                pass.beforeBarriers.push_back(b);
+                ++ret.aliasingBarrierCount;
+            }
+
+            if(r.beforeState != r.inState)
+            {
+                addTransitions(
+                    pass.beforeBarriers,
+                    r.splitBeginPass >= 0 ?
+                        FrameGraphReportBarrier::Type::SplitEnd :
+                        FrameGraphReportBarrier::Type::Transition,
+                    r.beforeState, r.inState, ret.transitionCount);
+            }
+
+            if(r.uavBarrier)
+            {
+                FrameGraphReportBarrier b;
+                b.type   = FrameGraphReportBarrier::Type::UAV;
+                b.rscIdx = rscIdx;
+                pass.beforeBarriers.push_back(b);
+                ++ret.uavBarrierCount;
+            }
+
+            if(r.inState != r.afterState)
+            {
+                addTransitions(
+                    pass.afterBarriers,
+                    FrameGraphReportBarrier::Type::Transition,
+                    r.inState, r.afterState, ret.transitionCount);
+            }
+            else if(r.splitEndPass >= 0)
+            {
+                addTransitions(
+                    pass.afterBarriers,
+                    FrameGraphReportBarrier::Type::SplitBegin,
+                    r.inState, r.splitEndState, ret.splitBarrierCandidateCount);
+            }
+
+            if(r.outUAVBarrier)
+            {
+                FrameGraphReportBarrier b;
+                b.type   = FrameGraphReportBarrier::Type::UAV;
+                b.rscIdx = rscIdx;
+                pass.afterBarriers.push_back(b);
+                ++ret.uavBarrierCount;
+            }
+        }
+    }
+
+    return ret;
+}
+
+std::string toJSON(const FrameGraphReport &report)
+{
+    std::ostringstream out;
+
+    out << "{\n";
+
+    out << "\"descriptors\":{"
+        << "\"frameGPU\":"  << report.gpuDescCount
+        << ",\"frameRTV\":" << report.rtvDescCount
+        << ",\"frameDSV\":" << report.dsvDescCount
+        << ",\"graphGPU\":" << report.graphGPUDescCount
+        << ",\"graphRTV\":" << report.graphRTVDescCount
+        << ",\"graphDSV\":" << report.graphDSVDescCount
+        << "},\n";
+
+    auto &stats = report.statistics;
+    out << "\"statistics\":{"
+        << "\"transitionCount\":"       << report.transitionCount
+        << ",\"splitBarrierCandidateCount\":"
+            << report.splitBarrierCandidateCount
+        << ",\"aliasingBarrierCount\":" << report.aliasingBarrierCount
+        << ",\"uavBarrierCount\":"      << report.uavBarrierCount
+        << ",\"elidedUAVBarrierCount\":" << stats.elidedUAVBarrierCount
+        << ",\"mergedPassCount\":"     << stats.mergedPassCount
+        << ",\"internalMemory\":"       << report.internalMemory
+        << ",\"transientMemoryBeforeAliasing\":"
+            << stats.transientMemoryBeforeAliasing
+        << ",\"transientMemoryAfterAliasing\":"
+            << stats.transientMemoryAfterAliasing
+        << ",\"aliasedRscCount\":"       << stats.aliasedRscCount
+        << ",\"culledPassCount\":"       << stats.culledPasses.size()
+        << ",\"culledRscCount\":"        << stats.culledRscs.size()
+        << ",\"asyncComputePassCount\":" << stats.asyncComputePassCount
+        << ",\"copyQueuePassCount\":"    << stats.copyQueuePassCount
+        << ",\"crossQueueWaitCount\":"   << stats.crossQueueWaitCount
+        << "},\n";
+
+    out << "\"resources\":[";
+    for(size_t i = 0; i < report.rscs.size(); ++i)
+    {
+        auto &r = report.rscs[i];
+        out << (i ? "," : "") << "\n{"
+            << "\"idx\":"        << r.idx
+            << ",\"external\":"  << (r.isExternal ? "true" : "false")
+            << ",\"culled\":"    << (r.isCulled ? "true" : "false")
+            << ",\"aliased\":"   << (r.isAliased ? "true" : "false")
+            << ",\"backbufferRelative\":"
+                << (r.isBackbufferRelative ? "true" : "false")
+            << ",\"historyRing\":" << r.historyRing
+            << ",\"dimension\":" << r.desc.Dimension
+            << ",\"format\":"    << r.desc.Format
+            << ",\"width\":"     << r.desc.Width
+            << ",\"height\":"    << r.desc.Height
+            << ",\"depthOrArraySize\":" << r.desc.DepthOrArraySize
+            << ",\"mipLevels\":" << r.desc.MipLevels
+            << ",\"flags\":"     << r.desc.Flags
+            << ",\"byteSize\":"  << r.byteSize
+            << ",\"firstPass\":" << r.firstPass
+            << ",\"lastPass\":"  << r.lastPass
+            << "}";
+    }
+    out << "\n],\n";
+
+    out << "\"passes\":[";
+    for(size_t i = 0; i < report.passes.size(); ++i)
+    {
+        auto &p = report.passes[i];
+        out << (i ? "," : "") << "\n{"
+            << "\"idx\":"      << i
+            << ",\"name\":\""  << escape(p.name) << "\""
+            << ",\"declIdx\":" << p.declIdx
+            << ",\"type\":\""  << (p.isGraphics ? "graphics" : "compute") << "\""
+            << ",\"queue\":\"" << queueToString(p.sync.queue) << "\"";
+
+        out << ",\"waits\":[";
+        bool firstWait = true;
+        for(int q = 0; q < FRAME_GRAPH_QUEUE_COUNT; ++q)
+        {
+            if(p.sync.waitPasses[q] < 0)
+                continue;
+            out << (firstWait ? "" : ",") << p.sync.waitPasses[q];
+            firstWait = false;
+        }
+        out << "],\"waitPrevFrame\":"
+            << (p.sync.waitPrevFrame ? "true" : "false");
+
+        out << ",\"resources\":[";
+        for(size_t j = 0; j < p.rscs.size(); ++j)
+        {
+            auto &r = p.rscs[j];
+            out << (j ? "," : "")
+                << "{\"rsc\":" << r.rscIdx
+                << ",\"view\":\"" << r.view << "\""
+                << ",\"state\":\"" << stateToString(r.inState) << "\"}";
+        }
+        out << "]";
+
+        out << ",\"barriersBefore\":";
+        writeBarriersJSON(out, p.beforeBarriers);
+        out << ",\"barriersAfter\":";
+        writeBarriersJSON(out, p.afterBarriers);
+
+        out << "}";
+    }
+    out << "\n]\n}\n";
+
+    return out.str();
+}
+
+std::string toGraphvizDOT(const FrameGraphReport &report)
+{
+    std::ostringstream out;
+
+    out << "digraph FrameGraph {\n"
+        << "  rankdir=LR;\n"
+        << "  node [fontname=\"Consolas\", fontsize=10];\n"
+        << "  edge [fontname=\"Consolas\", fontsize=8];\n";
+
+    for(size_t i = 0; i < report.passes.size(); ++i)
+    {
+        auto &p = report.passes[i];
+
+        std::string label = escape(p.name) + "\\n" +
+                            queueToString(p.sync.queue) + " queue";
+
+        for(auto &b : p.beforeBarriers)
+        {
+            label += std::string("\\n") + barrierTypeToString(b.type) +
+                     " rsc " + std::to_string(b.rscIdx);
+        }
+
+        const char *color =
+            p.sync.queue == FrameGraphQueue::Compute ? "lightblue" :
+            p.sync.queue == FrameGraphQueue::Copy    ? "lightyellow" :
+                                                       "lightgrey";
+
+        out << "  pass" << i << " [shape=box, style=filled, fillcolor="
+            << color << ", label=\"" << label << "\"];\n";
+    }
+
+    for(auto &r : report.rscs)
+    {
+        if(r.firstPass < 0)
+            continue;
+
+        out << "  rsc" << r.idx << " [shape=ellipse, "
+            << (r.isExternal ? "style=dashed, " : "")
+            << "label=\"" << getRscLabel(r) << "\"];\n";
+    }
+
+    for(size_t i = 0; i < report.passes.size(); ++i)
+    {
+        auto &p = report.passes[i];
+
+        for(auto &r : p.rscs)
+        {
+            const std::string state = stateToString(r.inState);
+            if(r.inState & WRITE_STATES)
+            {
+                out << "  pass" << i << " -> rsc" << r.rscIdx
+                    << " [color=red, label=\"" << state << "\"];\n";
+            }
+            else
+            {
+                out << "  rsc" << r.rscIdx << " -> pass" << i
+                    << " [label=\"" << state << "\"];\n";
+            }
+        }
+
+        for(int q = 0; q < FRAME_GRAPH_QUEUE_COUNT; ++q)
+        {
+            if(p.sync.waitPasses[q] >= 0)
+            {
+                out << "  pass" << p.sync.waitPasses[q] << " -> pass" << i
+                    << " [style=dashed, color=blue, label=\"wait\"];\n";
+            }
+        }
+    }
+
+    out << "}\n";
+
+    return out.str();
+}
+
+AGZ_D3D12_FG_END
@@ -18,28 +18,39 @@ ResourceReleaser::~ResourceReleaser()
         match_variant(r.releaser,
             [&](ObjRecord             &   ) {                },
             [&](RscAllocRecord        &rar) { rar.release(); },
+            [&](MemoryAllocRecord     &mar) { mar.release(); },
             [&](DescriptorRangeRecord &drr) { drr.release(); },
-            [&](DescriptorHeapRecord  &dhr) { dhr.release(); });
+            [&](DescriptorHeapRecord  &dhr) { dhr.release(); },
+            [&](BundleRecord          &   ) {                });
     }
 }
 
 void ResourceReleaser::collect()
 {
-    std::vector<Record> newRecords;
-    for(auto &r : records_)
+    // compact in place, so that collecting in each frame does not allocate
+
+    size_t keptCount = 0;
+    for(size_t i = 0; i < records_.size(); ++i)
     {
+        auto &r = records_[i];
         if(fence_->GetCompletedValue() >= r.expectedFenceValue)
         {
             match_variant(r.releaser,
                 [&](ObjRecord             &   ) {                },
                 [&](RscAllocRecord        &rar) { rar.release(); },
+                [&](MemoryAllocRecord     &mar) { mar.release(); },
                 [&](DescriptorRangeRecord &drr) { drr.release(); },
-                [&](DescriptorHeapRecord  &dhr) { dhr.release(); });
+                [&](DescriptorHeapRecord  &dhr) { dhr.release(); },
+            [&](BundleRecord          &   ) {                });
         }
         else
-            newRecords.push_back(std::move(r));
+        {
+            if(keptCount != i)
+                records_[keptCount] = std::move(r);
+            ++keptCount;
+        }
     }
-    records_.swap(newRecords);
+    records_.erase(records_.begin() + keptCount, records_.end());
 }
 
 void ResourceReleaser::addReleasePoint(ID3D12CommandQueue *cmdQueue)
@@ -63,6 +74,17 @@ void ResourceReleaser::add(
         });
 }
 
+void ResourceReleaser::add(
+    fg::ResourceAllocator &rscAlloc,
+    D3D12MA::Allocation   *memory)
+{
+    records_.push_back(
+        {
+            MemoryAllocRecord{ &rscAlloc, memory },
+            nextExpectedFenceValue_
+        });
+}
+
 void ResourceReleaser::add(
     DescriptorSubHeap &subheap, DescriptorRange range)
 {
@@ -82,4 +104,25 @@ void ResourceReleaser::add(std::unique_ptr<DescriptorHeap> heap)
         });
 }
 
+void ResourceReleaser::add(
+    ComPtr<ID3D12CommandAllocator>    bundleAllocator,
+    ComPtr<ID3D12GraphicsCommandList> bundle)
+{
+    records_.push_back(
+        {
+            BundleRecord{ std::move(bundleAllocator), std::move(bundle) },
+            nextExpectedFenceValue_
+        });
+}
+
+void ResourceReleaser::takeRecordsFrom(ResourceReleaser &other)
+{
+    for(auto &r : other.records_)
+    {
+        r.expectedFenceValue = nextExpectedFenceValue_;
+        records_.push_back(std::move(r));
+    }
+    other.records_.clear();
+}
+
 AGZ_D3D12_FG_END
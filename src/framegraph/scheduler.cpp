@@ -1,114 +1,374 @@
+#include <algorithm>
+
 #include <agz/d3d12/framegraph/scheduler.h>
 
 AGZ_D3D12_FG_BEGIN
 
 FrameGraphTaskScheduler::FrameGraphTaskScheduler(
-    const std::vector<FrameGraphPassNode> &passNodes,
-    CommandListPool                       &cmdListPool,
-    ComPtr<ID3D12CommandQueue>             cmdQueue)
-    : passNodes_(passNodes),
+    ID3D12Device *device, CommandListPool &cmdListPool)
+    : passNodes_(nullptr),
+      passSyncs_(nullptr),
       cmdListPool_(cmdListPool),
-      cmdQueue_(std::move(cmdQueue)),
-      dispatchedNodeCount_(0),
-      finishedNodeCount_(0)
+      cmdQueues_{},
+      nextTask_(0),
+      completionRingCapacity_(0),
+      nextSubmittedTask_(0),
+      submittedQueue_(FrameGraphQueue::Graphics),
+      fenceValues_{},
+      isQueueUsed_{},
+      prevFrameFenceValue_(0),
+      estimatedPassNodes_(nullptr)
 {
-    tasks_.resize(passNodes_.size());
-    restart();
+    submittingFlag_.clear();
+
+    for(auto &f : fences_)
+    {
+        AGZ_D3D12_CHECK_HR(
+            device->CreateFence(
+                0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(f.GetAddressOf())));
+    }
 }
 
-void FrameGraphTaskScheduler::restart()
+void FrameGraphTaskScheduler::setBatchingOptions(
+    const FrameGraphTaskBatchingOptions &options)
 {
-    for(auto &t : tasks_)
+    batchingOptions_ = options;
+    estimatedPassNodes_ = nullptr;
+}
+
+const FrameGraphTaskBatchingOptions &
+    FrameGraphTaskScheduler::getBatchingOptions() const noexcept
+{
+    return batchingOptions_;
+}
+
+void FrameGraphTaskScheduler::restart(
+    const FrameGraphData      &graph,
+    const FrameGraphCmdQueues &cmdQueues,
+    int                        threadCount)
+{
+    const auto &passNodes = graph.passNodes;
+
+    passNodes_ = &passNodes;
+    passSyncs_ = &graph.passSyncs;
+    cmdQueues_ = cmdQueues;
+
+    // update pass cost estimations
+
+    if(estimatedPassNodes_ != &passNodes ||
+       passCosts_.size() != passNodes.size())
+    {
+        estimatedPassNodes_ = &passNodes;
+        passCosts_.assign(
+            passNodes.size(), batchingOptions_.defaultPassCost);
+        measuredPassCosts_.assign(passNodes.size(), -1.0f);
+    }
+    else
     {
-        t.taskState = TaskState::NotFinished;
-        t.nodeCount = 0;
-        t.cmdList.Reset();
+        const float w = batchingOptions_.measuredCostWeight;
+        for(size_t i = 0; i < passCosts_.size(); ++i)
+        {
+            if(measuredPassCosts_[i] >= 0)
+            {
+                passCosts_[i] = (1 - w) * passCosts_[i]
+                              + w * measuredPassCosts_[i];
+                measuredPassCosts_[i] = -1;
+            }
+        }
     }
 
-    dispatchedNodeCount_ = 0;
-    finishedNodeCount_ = 0;
+    // split passes into tasks
+
+    splitTasks(threadCount);
+
+    // reset completion ring
+
+    if(completionRingCapacity_ < tasks_.size())
+    {
+        completionRingCapacity_ = tasks_.size();
+        completionRing_ = std::make_unique<CompletionSlot[]>(
+            completionRingCapacity_);
+    }
+
+    for(size_t i = 0; i < tasks_.size(); ++i)
+    {
+        completionRing_[i].cmdList.Reset();
+        completionRing_[i].completed = false;
+    }
+
+    submittedCmdLists_.reserve(tasks_.size());
+    passSignalValues_.resize(passNodes.size());
+
+    for(auto &used : isQueueUsed_)
+        used = false;
+
+    nextTask_          = 0;
+    nextSubmittedTask_ = 0;
+    submittingFlag_.clear();
+}
+
+void FrameGraphTaskScheduler::splitTasks(int threadCount)
+{
+    // take passes until the estimated cost of a task reaches
+    // total cost / (threads * tasksPerThread)
+
+    float totalCost = 0;
+    for(auto c : passCosts_)
+        totalCost += c;
+
+    const int taskCount = (std::max)(
+        1, (std::max)(threadCount, 1) * batchingOptions_.tasksPerThread);
+    const float taskCost = totalCost / static_cast<float>(taskCount);
+
+    const size_t passCount = passNodes_->size();
+    const size_t maxCount  = batchingOptions_.maxPassesPerTask ?
+                             batchingOptions_.maxPassesPerTask : passCount;
+
+    tasks_.clear();
+
+    // cmd queue waits are issued before a task and signals after it
+
+    const auto &syncs = *passSyncs_;
+
+    auto hasWait = [&](size_t passIdx)
+    {
+        const auto &sync = syncs[passIdx];
+        if(sync.waitPrevFrame)
+            return true;
+        for(auto w : sync.waitPasses)
+        {
+            if(w >= 0)
+                return true;
+        }
+        return false;
+    };
+
+    auto getChunkCount = [&](size_t passIdx)
+    {
+        return (*passNodes_)[passIdx].getPassData().chunkCount;
+    };
+
+    size_t begIdx = 0;
+    while(begIdx < passCount)
+    {
+        const FrameGraphQueue queue = syncs[begIdx].queue;
+        assert(cmdQueues_[static_cast<int>(queue)]);
+
+        if(const uint32_t chunkCount = getChunkCount(begIdx); chunkCount > 1)
+        {
+            for(uint32_t c = 0; c < chunkCount; ++c)
+                tasks_.push_back({ begIdx, begIdx + 1, queue, { c, chunkCount } });
+            ++begIdx;
+            continue;
+        }
+
+        size_t endIdx = begIdx + 1;
+        float cost = passCosts_[begIdx];
+
+        // merged passes are never split into different tasks
+
+        auto isMergedWithPrev = [&](size_t passIdx)
+        {
+            return (*passNodes_)[passIdx].getPassData().mergedWithPrev;
+        };
+
+        while(endIdx < passCount &&
+              (isMergedWithPrev(endIdx) ||
+               (endIdx - begIdx < maxCount &&
+                cost + passCosts_[endIdx] <= taskCost &&
+                !syncs[endIdx - 1].signal &&
+                syncs[endIdx].queue == queue &&
+                !hasWait(endIdx) &&
+                getChunkCount(endIdx) == 1)))
+            cost += passCosts_[endIdx++];
+
+        tasks_.push_back({ begIdx, endIdx, queue });
+        begIdx = endIdx;
+    }
 }
 
 FrameGraphTaskScheduler::TaskRange FrameGraphTaskScheduler::requestTask()
 {
-    if(dispatchedNodeCount_ >= passNodes_.size())
-        return { nullptr, nullptr };
+    const size_t taskIdx = nextTask_.fetch_add(1);
+    if(taskIdx >= tasks_.size())
+        return {};
 
-    // IMPROVE: dispatch more nodes per request
+    const auto &task = tasks_[taskIdx];
+    const auto passNodes = passNodes_->data();
 
-    tasks_[dispatchedNodeCount_].taskState = TaskState::NotFinished;
-    const auto passNode = &passNodes_[dispatchedNodeCount_++];
+    return {
+        passNodes + task.beg, passNodes + task.end,
+        taskIdx, task.queue, task.chunk
+    };
+}
 
-    return { passNode, passNode + 1 };
+void FrameGraphTaskScheduler::reportPassCost(
+    size_t passIdx, float microseconds) noexcept
+{
+    measuredPassCosts_[passIdx] = microseconds;
 }
 
 void FrameGraphTaskScheduler::submitTask(
     TaskRange                         taskRange,
     ComPtr<ID3D12GraphicsCommandList> cmdList)
 {
-    std::vector<ID3D12CommandList *> cmdLists;
-    std::vector<ID3D12GraphicsCommandList *> gCmdLists;
+    // publish
 
-    const size_t begNodeIdx = taskRange.begNode - &passNodes_[0];
-    const size_t endNodeIdx = taskRange.endNode - &passNodes_[0];
-    const size_t nodeCount  = taskRange.endNode - taskRange.begNode;
+    auto &slot = completionRing_[taskRange.taskIdx];
+    slot.cmdList = std::move(cmdList);
+    slot.completed.store(true);
 
-    // pend
+    const size_t taskCount = tasks_.size();
 
-    if(begNodeIdx > 0 && tasks_[begNodeIdx - 1].taskState != TaskState::Submitted)
+    for(;;)
     {
-        tasks_[begNodeIdx].cmdList = std::move(cmdList);
-        tasks_[begNodeIdx].nodeCount = nodeCount;
+        // another thread is submitting. it will see this task
 
-        for(size_t i = begNodeIdx; i < endNodeIdx; ++i)
-            tasks_[i].taskState = TaskState::Pending;
+        if(submittingFlag_.test_and_set())
+            return;
 
-        return;
-    }
+        // submit completed tasks in order. consecutive tasks on the same
+        // queue are submitted together unless a wait/signal separates them
 
-    // submit
+        size_t next = nextSubmittedTask_.load();
+        const size_t firstSubmitted = next;
 
-    cmdLists.push_back(cmdList.Get());
-    gCmdLists.push_back(cmdList.Get());
+        // chunks of a pass may suspend and resume a render pass, which
+        // requires them to be in the same ExecuteCommandLists. thus a
+        // chunked pass is submitted only when all its chunks are completed
 
-    for(size_t i = begNodeIdx; i < endNodeIdx; ++i)
-        tasks_[i].taskState = TaskState::Submitted;
+        auto isCompleted = [&](size_t taskIdx)
+        {
+            if(!completionRing_[taskIdx].completed.load())
+                return false;
 
-    finishedNodeCount_ = endNodeIdx;
+            const auto &chunk = tasks_[taskIdx].chunk;
+            if(!chunk.isFirst())
+                return true;
 
-    size_t nodeIdx = endNodeIdx;
-    for(;;)
+            for(uint32_t c = 1; c < chunk.count; ++c)
+            {
+                if(!completionRing_[taskIdx + c].completed.load())
+                    return false;
+            }
+            return true;
+        };
+
+        while(next < taskCount && isCompleted(next))
+        {
+            const auto &task = tasks_[next];
+            const auto &sync = (*passSyncs_)[task.beg];
+            const int queue  = static_cast<int>(task.queue);
+
+            if(task.queue != submittedQueue_)
+                flushSubmittedCmdLists();
+
+            for(int q = 0; q < FRAME_GRAPH_QUEUE_COUNT; ++q)
+            {
+                if(sync.waitPasses[q] < 0 || !task.chunk.isFirst())
+                    continue;
+
+                flushSubmittedCmdLists();
+                cmdQueues_[queue]->Wait(
+                    fences_[q].Get(), passSignalValues_[sync.waitPasses[q]]);
+            }
+
+            if(sync.waitPrevFrame && prevFrameFenceValue_ &&
+               task.chunk.isFirst())
+            {
+                flushSubmittedCmdLists();
+                cmdQueues_[queue]->Wait(
+                    fences_[static_cast<int>(FrameGraphQueue::Graphics)].Get(),
+                    prevFrameFenceValue_);
+            }
+
+            submittedQueue_ = task.queue;
+            submittedCmdLists_.push_back(completionRing_[next].cmdList.Get());
+
+            if((*passSyncs_)[task.end - 1].signal && task.chunk.isLast())
+            {
+                flushSubmittedCmdLists();
+                cmdQueues_[queue]->Signal(
+                    fences_[queue].Get(), ++fenceValues_[queue]);
+                passSignalValues_[task.end - 1] = fenceValues_[queue];
+            }
+
+            isQueueUsed_[queue] = true;
+            ++next;
+        }
+
+        if(next != firstSubmitted)
+        {
+            flushSubmittedCmdLists();
+
+            for(size_t i = firstSubmitted; i < next; ++i)
+            {
+                cmdListPool_.addUnusedCommandList(
+                    tasks_[i].queue, std::move(completionRing_[i].cmdList));
+            }
+
+            nextSubmittedTask_.store(next);
+        }
+
+        submittingFlag_.clear();
+
+        // the next task may be published after the check above but before
+        // the flag is cleared. its thread may have seen the flag set
+
+        if(next >= taskCount || !isCompleted(next))
+            return;
+    }
+}
+
+bool FrameGraphTaskScheduler::isAllFinished() const noexcept
+{
+    return nextSubmittedTask_.load() >= tasks_.size();
+}
+
+void FrameGraphTaskScheduler::joinQueues()
+{
+    constexpr int GRAPHICS = static_cast<int>(FrameGraphQueue::Graphics);
+
+    // without other queues, the graphics queue is in order by itself
+
+    bool hasOtherQueues = false;
+    for(int q = 0; q < FRAME_GRAPH_QUEUE_COUNT; ++q)
     {
-        if(nodeIdx >= tasks_.size())
-            break;
+        if(q != GRAPHICS && cmdQueues_[q])
+            hasOtherQueues = true;
+    }
 
-        if(tasks_[nodeIdx].taskState != TaskState::Pending)
-            break;
+    if(!hasOtherQueues)
+        return;
 
-        assert(tasks_[nodeIdx].nodeCount > 0);
-        assert(tasks_[nodeIdx].cmdList);
-        cmdLists.push_back(tasks_[nodeIdx].cmdList.Get());
-        gCmdLists.push_back(tasks_[nodeIdx].cmdList.Get());
+    auto graphicsQueue = cmdQueues_[GRAPHICS];
 
-        const size_t nodeEnd = nodeIdx + tasks_[nodeIdx].nodeCount;
-        for(size_t i = nodeIdx; i < nodeEnd; ++i)
-            tasks_[i].taskState = TaskState::Submitted;
+    for(int q = 0; q < FRAME_GRAPH_QUEUE_COUNT; ++q)
+    {
+        if(q == GRAPHICS || !isQueueUsed_[q])
+            continue;
 
-        nodeIdx = nodeEnd;
-        finishedNodeCount_ = nodeEnd;
+        cmdQueues_[q]->Signal(fences_[q].Get(), ++fenceValues_[q]);
+        graphicsQueue->Wait(fences_[q].Get(), fenceValues_[q]);
     }
 
-    assert(!cmdLists.empty());
-    cmdQueue_->ExecuteCommandLists(
-        static_cast<UINT>(cmdLists.size()), cmdLists.data());
+    // passes on other queues in the next frame may wait for this frame
 
-    for(auto &c : gCmdLists)
-        cmdListPool_.addUnusedGraphicsCmdLists(c);
+    graphicsQueue->Signal(
+        fences_[GRAPHICS].Get(), ++fenceValues_[GRAPHICS]);
+    prevFrameFenceValue_ = fenceValues_[GRAPHICS];
 }
 
-bool FrameGraphTaskScheduler::isAllFinished() const noexcept
+void FrameGraphTaskScheduler::flushSubmittedCmdLists()
 {
-    return finishedNodeCount_ >= tasks_.size();
+    if(submittedCmdLists_.empty())
+        return;
+
+    cmdQueues_[static_cast<int>(submittedQueue_)]->ExecuteCommandLists(
+        static_cast<UINT>(submittedCmdLists_.size()),
+        submittedCmdLists_.data());
+
+    submittedCmdLists_.clear();
 }
 
 AGZ_D3D12_FG_END